@@ -14,6 +14,7 @@
 
 #include <cstdio>
 #include "matrix-ops.hh"
+#include "matrix-io.hh"
 
 struct BitIndexer;
 
@@ -35,6 +36,8 @@ public:
   int n_global, m_global;
   // number of load and store statements
   int n_stores, n_loads;
+  // #threads for merging the equivalent pointers/objects
+  int n_threads;
 
   BIT_GENERATE_INDEX fp_generate_index;
   BIT_EXTERNALIZE_INDEX fp_externalize_index;
@@ -47,6 +50,7 @@ public:
     distribute_map = NULL;
     n_global = m_global = 0;
     n_stores = n_loads = 0;
+    n_threads = 1;
     fp_generate_index = NULL;
     fp_externalize_index = NULL;
   }
@@ -66,12 +70,12 @@ public:
 };
 
 
-// Parm 1 : input file handler
-// Parm 2 : input file format
+// Parm 1 : the reader of the input matrix
+// Parm 2 : #threads for decoding the input
 extern BitIndexer*
-parse_points_to_input( std::FILE*, int );
+parse_points_to_input( MatrixReader*, int );
 
 extern BitIndexer*
-parse_side_effect_input( std::FILE*, int );
+parse_side_effect_input( MatrixReader*, int );
 
 #endif
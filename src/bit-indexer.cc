@@ -26,6 +26,8 @@ static int matrix_type = PT_MATRIX;
 static bool profile_in_detail = false;
 static bool binarization = false;
 static bool merging_eqls = true;
+static int n_threads = 1;
+static long mem_budget = DEFAULT_MEM_BUDGET;
 
 
 // Program options
@@ -42,9 +44,13 @@ print_help(const char* prog_name)
   fprintf( stderr, "-B       : Directly output the input matrix in binary format. Don't make index.\n" );
   fprintf( stderr, "-F       : Specify the format of the input file\n" );
   fprintf( stderr, "       0 : Each line starts with the number of the following elements (default);\n" );
-  fprintf( stderr, "       1 : Each line ends with -1.\n" );
+  fprintf( stderr, "       1 : Each line ends with -1;\n" );
+  fprintf( stderr, "       3 : Unsorted edge list, one (pointer, object) pair per line.\n" );
+  fprintf( stderr, "-M [num] : Sort the edge list with num MB memory, then spill to the disk (default = %d).\n", DEFAULT_MEM_BUDGET_MB );
   fprintf( stderr, "-g       : Give a comprehensive profiling of the intermediate results.\n" );
+  fprintf( stderr, "-t [num] : Use num worker threads (default = 1).\n" );
   fprintf( stderr, "-h       : Show this help.\n" );
+  fprintf( stderr, "The input_file can be - for reading the matrix from the standard input.\n" );
 }
 
 static bool 
@@ -52,7 +58,7 @@ parse_options( int argc, char **argv )
 {
   int c;
 
-  while ( (c = getopt( argc, argv, "e:jF:gBh" ) ) != -1 ) {
+  while ( (c = getopt( argc, argv, "e:jF:gBht:M:" ) ) != -1 ) {
     switch ( c ) {
     case 'e':
       matrix_type = atoi( optarg );
@@ -74,6 +80,15 @@ parse_options( int argc, char **argv )
       binarization = true;
       break;
 
+    case 't':
+      n_threads = atoi( optarg );
+      if ( n_threads < 1 ) n_threads = 1;
+      break;
+
+    case 'M':
+      mem_budget = atol( optarg ) << 20;
+      break;
+
     case 'h':
       print_help( argv[0] );
       return false;
@@ -110,10 +125,10 @@ parse_options( int argc, char **argv )
 static BitIndexer*
 input()
 {
-  FILE *fp;
+  MatrixReader *reader;
 
-  fp = fopen( input_file, "r" );
-  if ( fp == NULL ) {
+  reader = open_matrix_reader( input_file, matrix_type, input_format, mem_budget );
+  if ( reader == NULL ) {
     fprintf( stderr, "Loading file failed.\n" );
     return NULL;
   }
@@ -122,13 +137,13 @@ input()
   fprintf( stderr, "\n------------Input:%s-----------\n", input_file );
 
   if ( matrix_type == PT_MATRIX ) {
-    indexer = parse_points_to_input( fp, input_format );
+    indexer = parse_points_to_input( reader, n_threads );
   }
   else {
-    indexer = parse_side_effect_input( fp, input_format );
+    indexer = parse_side_effect_input( reader, n_threads );
   }
 
-  fclose( fp );
+  delete reader;
   show_res_use( "Input" );
 
   return indexer;
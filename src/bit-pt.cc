@@ -17,14 +17,14 @@
 using namespace std;
 
 static void
-compute_alias_matrix( Cmatrix** imats, bool merging_eqls )
+compute_alias_matrix( Cmatrix** imats, bool merging_eqls, int n_threads )
 {
   Cmatrix *ptm = imats[I_PT_MATRIX];
   Cmatrix *ptm_T = NULL;
 
   if ( merging_eqls ) {
-    compress_equivalent_rows( ptm );
-    ptm_T = compress_equivalent_columns( ptm );
+    compress_equivalent_rows( ptm, n_threads );
+    ptm_T = compress_equivalent_columns( ptm, n_threads );
   }
   else {
     ptm_T = transpose( ptm );
@@ -41,7 +41,7 @@ generate_index( BitIndexer* pt_indexer, bool merging_eqls )
   Cmatrix **imats = pt_indexer->imats;
 
   // Generate
-  compute_alias_matrix( imats, merging_eqls );
+  compute_alias_matrix( imats, merging_eqls, pt_indexer->n_threads );
   
   fprintf( stderr, "\n-----------Points-to Index-------------\n" );
   show_res_use( "Bitmap indexing" );
@@ -171,36 +171,38 @@ externalize_index( BitIndexer* pt_indexer, FILE *fp, bool binarization )
 }
 
 BitIndexer*
-parse_points_to_input( FILE *fp, int fmt )
+parse_points_to_input( MatrixReader* reader, int n_threads )
 {
-  int i, k;
-  int n, m;
-  int dst;
+  int i, j, k;
+  const int *cols;
 
   __init_matrix_lib();
-  fscanf( fp, "%d %d", &n, &m );
+  int n = reader->n;
+  int m = reader->m;
 
   // create
   Cmatrix *ptm = new Cmatrix( n, m );
   bitmap *mat = ptm->mat;
 
-  for ( i = 0; i < n; ++i ) {
-    if ( fmt == INPUT_START_BY_SIZE ) {
-      fscanf( fp, "%d", &k );
-    }
-    else
-      // set a large value to k
-      k = ((unsigned)(-1)>>1);
-    
-    while ( k > 0 ) {
-      fscanf( fp, "%d", &dst );
-      if ( fmt == INPUT_END_BY_MINUS_ONE ) {
-	if ( dst == -1 ) 
-	  break;
+  ParsedMatrix *pm = NULL;
+  if ( n_threads > 1 )
+    pm = reader->parse_in_parallel( n_threads, false );
+
+  if ( pm != NULL ) {
+    // Every thread fills the rows it has decoded
+    scatter_rows( pm, mat );
+    delete pm;
+  }
+  else {
+    for ( i = 0; i < n; ++i ) {
+      k = reader->next_row( NULL, &cols );
+      if ( k == -1 ) {
+	delete ptm;
+	return NULL;
       }
       
-      k--;
-      bitmap_set_bit( mat[i], dst );
+      for ( j = 0; j < k; ++j )
+	bitmap_set_bit( mat[i], cols[j] );
     }
   }
   
@@ -216,6 +218,7 @@ parse_points_to_input( FILE *fp, int fmt )
   pt_indexer->imats = pt_set;
   pt_indexer->n_len = N_OF_LOADABLE_PT_INDEX;
   pt_indexer->n_global = n;
+  pt_indexer->n_threads = n_threads;
   pt_indexer->m_global = m;
   pt_indexer->fp_generate_index = generate_index;
   pt_indexer->fp_externalize_index = externalize_index;
@@ -28,8 +28,8 @@ generate_index( BitIndexer* se_indexer, bool merging_eqls )
   Cmatrix *m_store = NULL, *m_load = NULL;
   
   if ( merging_eqls ) {
-    m_store = compress_equivalent_columns( m_store_T );
-    m_load = compress_equivalent_columns( m_load_T );
+    m_store = compress_equivalent_columns( m_store_T, se_indexer->n_threads );
+    m_load = compress_equivalent_columns( m_load_T, se_indexer->n_threads );
   }
   else {
     m_store = transpose( m_store_T );
@@ -171,15 +171,16 @@ externalize_index( BitIndexer* se_indexer, FILE *fp, bool binarization )
 }
 
 BitIndexer*
-parse_side_effect_input( FILE *fp, int fmt )
+parse_side_effect_input( MatrixReader* reader, int n_threads )
 {
-  int i, k;
-  int dst, type;
+  int i, j, k;
+  int type;
   int n_ld, n_st;
-  int n, m;
+  const int *cols;
   
   __init_matrix_lib();
-  fscanf( fp, "%d %d", &n, &m );
+  int n = reader->n;
+  int m = reader->m;
 
   // Loading the transpose of the side-effect matrix
   Cmatrix *store_T = new Cmatrix( m, n );
@@ -191,40 +192,59 @@ parse_side_effect_input( FILE *fp, int fmt )
   n_ld = n_st = 0;
   int *distribute_map = new int[n];
 
-  for ( i = 0; i < n; ++i ) {
-    // the store/load flag
-    fscanf( fp, "%d", &type );
+  ParsedMatrix *pm = NULL;
+  if ( n_threads > 1 )
+    pm = reader->parse_in_parallel( n_threads, true );
 
-    if ( fmt == INPUT_START_BY_SIZE ) {
-      fscanf( fp, "%d", &k );
+  if ( pm != NULL ) {
+    // The rows are decoded in parallel
+    // Statement i is the row_ids[i]-th store or load
+    int *row_ids = new int[n];
+    for ( i = 0; i < n; ++i ) {
+      if ( pm->row_types[i] == SE_LOAD ) {
+	row_ids[i] = n_ld;
+	distribute_map[i] = n + n_ld;
+	++n_ld;
+      }
+      else {
+	row_ids[i] = n_st;
+	distribute_map[i] = n_st;
+	++n_st;
+      }
     }
-    else
-      // set a large value to k
-      k = ((unsigned)(-1)>>1);    
 
-    while ( k > 0 ) {
-      fscanf( fp, "%d", &dst );
-      if ( fmt == INPUT_END_BY_MINUS_ONE ) {
-	if ( dst == -1 ) 
-	  break;
+    scatter_transposed( pm, mat_store_T, mat_load_T, row_ids );
+    delete[] row_ids;
+    delete pm;
+  }
+  else {
+    for ( i = 0; i < n; ++i ) {
+      // the store/load flag is returned in type
+      k = reader->next_row( &type, &cols );
+      if ( k == -1 ) {
+	delete store_T;
+	delete load_T;
+	delete[] distribute_map;
+	return NULL;
       }
       
-      if ( type == SE_LOAD )
-	bitmap_set_bit( mat_load_T[dst], n_ld );
-      else
-	bitmap_set_bit( mat_store_T[dst], n_st );
-
-      k--;
-    }
-
-    // we offset n in order to distinguish the type of statement i
-    if ( type == SE_LOAD ) {
-      distribute_map[i] = n + n_ld;
-      ++n_ld;
-    }
-    else {
-      distribute_map[i] = n_st;
-      ++n_st;
+      for ( j = 0; j < k; ++j ) {
+	int dst = cols[j];
+	if ( type == SE_LOAD )
+	  bitmap_set_bit( mat_load_T[dst], n_ld );
+	else
+	  bitmap_set_bit( mat_store_T[dst], n_st );
+      }
+      
+      // we offset n in order to distinguish the type of statement i
+      if ( type == SE_LOAD ) {
+	distribute_map[i] = n + n_ld;
+	++n_ld;
+      }
+      else {
+	distribute_map[i] = n_st;
+	++n_st;
+      }
     }
   }
 
@@ -246,6 +266,7 @@ parse_side_effect_input( FILE *fp, int fmt )
   se_indexer->n_len = N_OF_LOADABLE_SE_INDEX;
   se_indexer->distribute_map = distribute_map;
   se_indexer->n_global = n;
+  se_indexer->n_threads = n_threads;
   se_indexer->m_global = m;
   se_indexer->n_stores = n_st;
   se_indexer->n_loads = n_ld;
@@ -0,0 +1,358 @@
+// Copyright 2014, Hong Kong University of Science and Technology. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * Implementation of the byte streams.
+ * bzip2 and gzip are decoded by libbz2 and zlib respectively.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <bzlib.h>
+#include <zlib.h>
+#include "byte-stream.hh"
+
+using namespace std;
+
+// The ring holds N_BLOCKS blocks of BLOCK_BYTES bytes
+#define N_BLOCKS 4
+#define BLOCK_BYTES (1 << 20)
+
+
+PipedStream::PipedStream()
+{
+  blocks = new char*[N_BLOCKS];
+  lens = new size_t[N_BLOCKS];
+  for ( int i = 0; i < N_BLOCKS; ++i ) {
+    blocks[i] = new char[BLOCK_BYTES];
+    lens[i] = 0;
+  }
+
+  head = count = 0;
+  pos = 0;
+  done = cancelled = running = false;
+  broken = false;
+
+  pthread_mutex_init( &lock, NULL );
+  pthread_cond_init( &not_empty, NULL );
+  pthread_cond_init( &not_full, NULL );
+}
+
+PipedStream::~PipedStream()
+{
+  stop();
+
+  for ( int i = 0; i < N_BLOCKS; ++i )
+    delete[] blocks[i];
+  delete[] blocks;
+  delete[] lens;
+
+  pthread_mutex_destroy( &lock );
+  pthread_cond_destroy( &not_empty );
+  pthread_cond_destroy( &not_full );
+}
+
+void*
+run_producer( void* arg )
+{
+  ((PipedStream*)arg)->producer_loop();
+  return NULL;
+}
+
+void
+PipedStream::start()
+{
+  if ( pthread_create( &producer, NULL, run_producer, this ) == 0 )
+    running = true;
+  else {
+    broken = true;
+    done = true;
+  }
+}
+
+void
+PipedStream::stop()
+{
+  if ( !running ) return;
+
+  pthread_mutex_lock( &lock );
+  cancelled = true;
+  pthread_cond_signal( &not_full );
+  pthread_mutex_unlock( &lock );
+
+  pthread_join( producer, NULL );
+  running = false;
+}
+
+void
+PipedStream::producer_loop()
+{
+  while ( true ) {
+    pthread_mutex_lock( &lock );
+    while ( count == N_BLOCKS && !cancelled )
+      pthread_cond_wait( &not_full, &lock );
+
+    if ( cancelled ) {
+      pthread_mutex_unlock( &lock );
+      break;
+    }
+
+    // The slot behind the last ready block is owned by the producer
+    int slot = ( head + count ) % N_BLOCKS;
+    pthread_mutex_unlock( &lock );
+
+    size_t len = 0;
+    bool more = produce( blocks[slot], BLOCK_BYTES, len );
+
+    pthread_mutex_lock( &lock );
+    if ( len > 0 ) {
+      lens[slot] = len;
+      ++count;
+    }
+    if ( !more ) done = true;
+    pthread_cond_signal( &not_empty );
+    pthread_mutex_unlock( &lock );
+
+    if ( !more ) break;
+  }
+}
+
+size_t
+PipedStream::read( char* buf, size_t len )
+{
+  size_t copied = 0;
+
+  pthread_mutex_lock( &lock );
+  while ( copied < len ) {
+    // Only block if we have nothing to return
+    while ( count == 0 && !done && copied == 0 )
+      pthread_cond_wait( &not_empty, &lock );
+    if ( count == 0 ) break;
+
+    // The head block is not touched by the producer until we release it
+    char *blk = blocks[head];
+    size_t k = lens[head] - pos;
+    if ( k > len - copied ) k = len - copied;
+
+    pthread_mutex_unlock( &lock );
+    memcpy( buf + copied, blk + pos, k );
+    pthread_mutex_lock( &lock );
+
+    copied += k;
+    pos += k;
+    if ( pos == lens[head] ) {
+      head = ( head + 1 ) % N_BLOCKS;
+      --count;
+      pos = 0;
+      pthread_cond_signal( &not_full );
+    }
+  }
+  pthread_mutex_unlock( &lock );
+
+  return copied;
+}
+
+
+// Decompressing bzip2 data, concatenated streams (e.g. by pbzip2) are supported
+class BzipStream : public PipedStream
+{
+public:
+  BzipStream( int fd )
+  {
+    fp = fdopen( fd, "rb" );
+    bzf = NULL;
+    stream_bytes = 0;
+    may_end = false;
+    if ( fp != NULL ) open_bz( NULL, 0 );
+    if ( bzf == NULL ) broken = true;
+    start();
+  }
+
+  ~BzipStream()
+  {
+    stop();
+    int err;
+    if ( bzf != NULL ) BZ2_bzReadClose( &err, bzf );
+    if ( fp != NULL ) fclose( fp );
+  }
+
+protected:
+  bool produce( char* buf, size_t cap, size_t& len );
+
+private:
+  void open_bz( void* unused, int n_unused )
+  {
+    int err;
+    bzf = BZ2_bzReadOpen( &err, fp, 0, 0, unused, n_unused );
+    if ( err != BZ_OK ) {
+      BZ2_bzReadClose( &err, bzf );
+      bzf = NULL;
+    }
+    stream_bytes = 0;
+  }
+
+private:
+  FILE *fp;
+  BZFILE *bzf;
+  // #bytes decoded from the current bzip2 stream
+  size_t stream_bytes;
+  // Set if the current stream is opened speculatively at the end of the file
+  bool may_end;
+  char unused_buf[BZ_MAX_UNUSED];
+};
+
+bool
+BzipStream::produce( char* buf, size_t cap, size_t& len )
+{
+  int err;
+
+  len = 0;
+  while ( len == 0 ) {
+    if ( bzf == NULL ) return false;
+
+    int got = BZ2_bzRead( &err, bzf, buf, cap );
+    if ( err == BZ_UNEXPECTED_EOF && may_end && stream_bytes == 0 && got == 0 ) {
+      // No more stream after the last one
+      BZ2_bzReadClose( &err, bzf );
+      bzf = NULL;
+      return false;
+    }
+
+    if ( err != BZ_OK && err != BZ_STREAM_END ) {
+      broken = true;
+      return false;
+    }
+
+    len = got;
+    stream_bytes += got;
+
+    if ( err == BZ_STREAM_END ) {
+      // Another stream may follow
+      void *unused;
+      int n_unused;
+      BZ2_bzReadGetUnused( &err, bzf, &unused, &n_unused );
+      memcpy( unused_buf, unused, n_unused );
+      BZ2_bzReadClose( &err, bzf );
+      bzf = NULL;
+
+      if ( n_unused > 0 || !feof( fp ) ) {
+	open_bz( unused_buf, n_unused );
+	may_end = ( n_unused == 0 );
+	if ( bzf == NULL ) {
+	  broken = true;
+	  return false;
+	}
+      }
+    }
+  }
+
+  return true;
+}
+
+
+// Decompressing gzip data, zlib handles the concatenated members
+class GzipStream : public PipedStream
+{
+public:
+  GzipStream( int fd )
+  {
+    gz = gzdopen( fd, "rb" );
+    if ( gz == NULL ) broken = true;
+    else gzbuffer( gz, BLOCK_BYTES );
+    start();
+  }
+
+  ~GzipStream()
+  {
+    stop();
+    if ( gz != NULL ) gzclose( gz );
+  }
+
+protected:
+  bool produce( char* buf, size_t cap, size_t& len );
+
+private:
+  gzFile gz;
+};
+
+bool
+GzipStream::produce( char* buf, size_t cap, size_t& len )
+{
+  len = 0;
+  if ( gz == NULL ) return false;
+
+  int got = gzread( gz, buf, cap );
+  if ( got < 0 ) {
+    broken = true;
+    return false;
+  }
+
+  len = got;
+  if ( got == 0 ) {
+    // Check the end is not caused by a truncated file
+    int err;
+    gzerror( gz, &err );
+    if ( err != Z_OK ) broken = true;
+    return false;
+  }
+
+  return true;
+}
+
+
+// Reading a descriptor directly, the writer on the other side runs in parallel with us
+class FileStream : public ByteStream
+{
+public:
+  FileStream( int fd )
+  {
+    this->fd = fd;
+    broken = false;
+  }
+
+  ~FileStream()
+  {
+    close( fd );
+  }
+
+  size_t read( char* buf, size_t len )
+  {
+    while ( !broken ) {
+      ssize_t got = ::read( fd, buf, len );
+      if ( got >= 0 ) return got;
+      if ( errno != EINTR ) broken = true;
+    }
+    return 0;
+  }
+
+  bool failed() { return broken; }
+
+private:
+  int fd;
+  bool broken;
+};
+
+ByteStream*
+open_file_stream( int fd )
+{
+  return new FileStream( fd );
+}
+
+ByteStream*
+open_compressed_stream( int fd )
+{
+  unsigned char magic[3];
+
+  if ( pread( fd, magic, 3, 0 ) != 3 ) return NULL;
+
+  if ( magic[0] == 'B' && magic[1] == 'Z' && magic[2] == 'h' )
+    return new BzipStream( fd );
+
+  if ( magic[0] == 0x1f && magic[1] == 0x8b )
+    return new GzipStream( fd );
+
+  return NULL;
+}
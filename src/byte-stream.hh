@@ -0,0 +1,83 @@
+// Copyright 2014, Hong Kong University of Science and Technology. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * Byte streams for the input matrices that cannot be mapped into memory, e.g. pipes and compressed files.
+ * The compressed files are decompressed by a producer thread.
+ * The parser consumes the decompressed blocks as soon as they are ready,
+ * so that I/O, decompression and parsing overlap.
+ */
+
+#ifndef BYTE_STREAM_H
+#define BYTE_STREAM_H
+
+#include <cstddef>
+#include <pthread.h>
+
+class ByteStream
+{
+public:
+  virtual ~ByteStream() {}
+
+  // Copy at most len bytes to buf
+  // Returns #bytes copied, 0 means the end of the stream
+  virtual size_t read( char* buf, size_t len ) = 0;
+
+  // Set if the stream is broken, e.g. the compressed data are corrupted
+  virtual bool failed() = 0;
+};
+
+/*
+ * The data are produced by a separate thread into a ring of blocks.
+ * The sub-classes define how a block is produced.
+ */
+class PipedStream : public ByteStream
+{
+public:
+  PipedStream();
+  virtual ~PipedStream();
+
+  size_t read( char* buf, size_t len );
+  bool failed() { return broken; }
+
+protected:
+  // Start the producer thread, called by the sub-class constructor
+  void start();
+
+  // Wait the producer thread to exit, called by the sub-class destructor
+  void stop();
+
+  // Fill buf with at most cap bytes, len receives #bytes produced
+  // Returns false at the end of the stream or on error (set broken then)
+  virtual bool produce( char* buf, size_t cap, size_t& len ) = 0;
+
+  bool broken;
+
+private:
+  friend void* run_producer( void* );
+  void producer_loop();
+
+private:
+  char **blocks;
+  size_t *lens;
+  int head, count;          // the ready blocks are [head, head+count) in the ring
+  size_t pos;               // consumed bytes in the head block
+  bool done, cancelled, running;
+  pthread_t producer;
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty, not_full;
+};
+
+// Open a plain stream for a file descriptor, e.g. a pipe
+// The file descriptor is owned by the stream
+extern ByteStream*
+open_file_stream( int fd );
+
+// Open a stream for a bzip2 or gzip compressed file descriptor
+// Returns NULL if the data are not compressed
+// The file descriptor is owned by the stream if it is opened
+extern ByteStream*
+open_compressed_stream( int fd );
+
+#endif
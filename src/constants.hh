@@ -19,6 +19,8 @@
 #define PESTRIE_SE_1 "SEP1"
 #define BITMAP_PT_1 "PTB1"
 #define BITMAP_SE_1 "SEB1"
+#define MATRIX_PT_1 "PTM1"      // binary points-to input matrix
+#define MATRIX_SE_1 "SEM1"      // binary side-effect input matrix
 
 // Categories of the input matrix
 #define UNDEFINED_MATRIX -1
@@ -32,11 +34,25 @@
 // Categories of the input matrix representation format
 #define INPUT_START_BY_SIZE 0
 #define INPUT_END_BY_MINUS_ONE 1
+#define INPUT_BINARY_CSR 2        // detected by the magic number, see matrix-io.hh
+#define INPUT_EDGE_LIST 3         // unsorted (row, column) pairs
+
+// Memory for sorting the edge list before spilling to the disk (MB)
+#define DEFAULT_MEM_BUDGET_MB 1024
+#define DEFAULT_MEM_BUDGET ( (long)DEFAULT_MEM_BUDGET_MB << 20 )
 
 // Ways to sort the rows for PesTrie construction.
 #define SORT_BY_SIZE 0
 #define SORT_BY_HUB_DEGREE 1
 #define SORT_BY_RANDOM 2
+#define SORT_BY_CROSS_EDGES 3     // greedily minimize the new cross edges
+#define SORT_BY_DRY_RUN 4         // replay the above orders and pick the smallest index
+
+// The dry run warns if the pairing of the cross edges generates more figures than this
+#define FIGURES_WARNING 1e8
+
+// An object pointed to by this many pointers is built by all the threads
+#define HUB_COLUMN_SIZE 65536
 
 // Categories of matrices in points-to/side-effect bitmap index
 #define N_OF_PT_INDEX 3
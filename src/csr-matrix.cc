@@ -0,0 +1,651 @@
+// Copyright 2014, Hong Kong University of Science and Technology. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * Building and compressing the CSR matrices.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include "csr-matrix.hh"
+#include "row-hash.hh"
+#include "ext-sort.hh"
+
+using namespace std;
+
+void
+CsrMatrix::remove_duplicates()
+{
+  long w = 0;
+  long s = 0;
+
+  for ( int i = 0; i < n; ++i ) {
+    long e = offs[i+1];
+    offs[i] = w;
+    for ( long j = s; j < e; ++j ) {
+      if ( j > s && elems[j] == elems[j-1] ) continue;
+      elems[w++] = elems[j];
+    }
+    s = e;
+  }
+
+  offs[n] = w;
+}
+
+
+CsrTransposer::CsrTransposer( int row, int col, bool hash_consing )
+{
+  n = row; m = col;
+  n_rows = 0;
+  row_lens = new int[row];
+  col_lens = new long[col];
+  memset( col_lens, 0, sizeof(long) * col );
+
+  cap = row + 16;
+  cols = new int[cap];
+  n_cols = 0;
+
+  col_fps = NULL;
+  last_row = NULL;
+  if ( hash_consing ) {
+    col_fps = new row_fp_t[col];
+    last_row = new int[col];
+    for ( int i = 0; i < col; ++i ) col_fps[i] = ROW_FP_SEED;
+    memset( last_row, -1, sizeof(int) * col );
+  }
+}
+
+CsrTransposer::~CsrTransposer()
+{
+  release();
+}
+
+void
+CsrTransposer::release()
+{
+  if ( row_lens != NULL ) delete[] row_lens;
+  if ( col_lens != NULL ) delete[] col_lens;
+  if ( cols != NULL ) delete[] cols;
+  if ( col_fps != NULL ) delete[] col_fps;
+  if ( last_row != NULL ) delete[] last_row;
+  row_lens = NULL;
+  col_lens = NULL;
+  cols = NULL;
+  col_fps = NULL;
+  last_row = NULL;
+}
+
+void
+CsrTransposer::append_row( const int* src, int k, int shift )
+{
+  if ( n_cols + k > cap ) {
+    long new_cap = cap * 2;
+    if ( new_cap < n_cols + k ) new_cap = n_cols + k;
+    int *buf = new int[new_cap];
+    memcpy( buf, cols, sizeof(int) * n_cols );
+    delete[] cols;
+    cols = buf;
+    cap = new_cap;
+  }
+
+  int *dst = cols + n_cols;
+  int i = n_rows;
+
+  if ( col_fps == NULL ) {
+    for ( int j = 0; j < k; ++j ) {
+      int c = src[j] + shift;
+      dst[j] = c;
+      col_lens[c]++;
+    }
+  }
+  else {
+    // The duplicated columns in a row are dropped, so the fingerprints are exact
+    int w = 0;
+    for ( int j = 0; j < k; ++j ) {
+      int c = src[j] + shift;
+      if ( last_row[c] == i ) continue;
+      last_row[c] = i;
+      col_fps[c] = row_fp_add( col_fps[c], i );
+      dst[w++] = c;
+      col_lens[c]++;
+    }
+    k = w;
+  }
+
+  n_cols += k;
+  row_lens[n_rows++] = k;
+}
+
+CsrMatrix*
+CsrTransposer::transpose()
+{
+  CsrMatrix *mat_T = new CsrMatrix( m, n );
+  long *offs = mat_T->offs;
+
+  // Counting sort by the columns
+  for ( int i = 0; i < m; ++i )
+    offs[i+1] = offs[i] + col_lens[i];
+
+  // col_lens is reused as the filling positions
+  memcpy( col_lens, offs, sizeof(long) * m );
+  int *elems = new int[n_cols];
+
+  // The rows are visited in order, so they are ascending in every column
+  long p = 0;
+  for ( int i = 0; i < n_rows; ++i ) {
+    int k = row_lens[i];
+    for ( int j = 0; j < k; ++j ) {
+      int c = cols[p++];
+      elems[ col_lens[c]++ ] = i;
+    }
+  }
+
+  mat_T->elems = elems;
+  mat_T->remove_duplicates();
+
+  release();
+  return mat_T;
+}
+
+// Two columns are candidates if they have the same fingerprint and length
+struct SameLength
+{
+  const long *col_lens;
+  bool operator()( int x, int y ) const { return col_lens[x] == col_lens[y]; }
+};
+
+CsrMatrix*
+CsrTransposer::transpose_distinct( int* c_reps )
+{
+  int i, j;
+
+  // Pick the first column of every fingerprint as the candidate representative
+  RowHashTable ht( m );
+  SameLength same;
+  same.col_lens = col_lens;
+
+  int n_reps = 0;
+  for ( i = 0; i < m; ++i ) {
+    if ( col_lens[i] == 0 )
+      c_reps[i] = -1;
+    else {
+      c_reps[i] = ht.insert( row_fp_finish( col_fps[i] ), i, same );
+      if ( c_reps[i] == i ) ++n_reps;
+    }
+  }
+
+  // Only the representatives are materialized
+  CsrMatrix *mat_T = new CsrMatrix( n_reps, n );
+  long *offs = mat_T->offs;
+  long *pos = new long[m];
+
+  n_reps = 0;
+  for ( i = 0; i < m; ++i ) {
+    if ( c_reps[i] == i ) {
+      pos[i] = offs[n_reps];
+      offs[n_reps+1] = offs[n_reps] + col_lens[i];
+      ++n_reps;
+    }
+  }
+  
+  int *elems = new int[ offs[n_reps] ];
+  long p = 0;
+  for ( i = 0; i < n_rows; ++i ) {
+    int k = row_lens[i];
+    for ( j = 0; j < k; ++j ) {
+      int c = cols[p++];
+      if ( c_reps[c] == c ) elems[ pos[c]++ ] = i;
+    }
+  }
+
+  // Verify the other columns against their representatives
+  for ( i = 0; i < m; ++i ) {
+    int r = c_reps[i];
+    if ( r != -1 && r != i ) pos[i] = pos[r] - col_lens[r];
+  }
+
+  bool collided = false;
+  p = 0;
+  for ( i = 0; i < n_rows && !collided; ++i ) {
+    int k = row_lens[i];
+    for ( j = 0; j < k; ++j ) {
+      int c = cols[p++];
+      int r = c_reps[c];
+      if ( r != c && elems[ pos[c]++ ] != i ) collided = true;
+    }
+  }
+
+  delete[] pos;
+  mat_T->elems = elems;
+
+  if ( collided ) {
+    // Two different columns share a fingerprint, we fall back to the full transpose
+    delete mat_T;
+    mat_T = transpose();
+    compress_equivalent_rows( mat_T, c_reps );
+    return mat_T;
+  }
+
+  // Renumber the representatives by their first appearances
+  n_reps = 0;
+  for ( i = 0; i < m; ++i ) {
+    if ( c_reps[i] == i )
+      c_reps[i] = n_reps++;
+    else if ( c_reps[i] != -1 )
+      c_reps[i] = c_reps[ c_reps[i] ];
+  }
+
+  release();
+  return mat_T;
+}
+
+
+DiskCsrMatrix::DiskCsrMatrix( int row, int col, long budget )
+{
+  n = row; m = col;
+  offs = new long[row+1];
+  memset( offs, 0, sizeof(long) * (row+1) );
+  facts = new ExternalSorter( budget );
+  fp = NULL;
+}
+
+DiskCsrMatrix::~DiskCsrMatrix()
+{
+  delete[] offs;
+  if ( facts != NULL ) delete facts;
+  if ( fp != NULL ) fclose( fp );
+}
+
+bool
+DiskCsrMatrix::add( int r, int c )
+{
+  return facts->add( ( (sort_key_t)r << 32 ) | (unsigned)c );
+}
+
+// The sorted pairs come row by row with ascending and unique elements, so they are written as they are
+bool
+DiskCsrMatrix::freeze()
+{
+  bool good = facts->finish();
+  if ( good ) {
+    fp = open_temp_file();
+    good = ( fp != NULL );
+  }
+
+  sort_key_t key;
+  while ( good && facts->next( key ) ) {
+    int c = (int)( key & 0xffffffff );
+    offs[ ( key >> 32 ) + 1 ]++;
+    good = ( fwrite( &c, sizeof(int), 1, fp ) == 1 );
+  }
+
+  for ( int i = 0; i < n; ++i )
+    offs[i+1] += offs[i];
+
+  delete facts;
+  facts = NULL;
+  return good && fflush( fp ) == 0;
+}
+
+void
+DiskCsrMatrix::read_row( int i, int* buf ) const
+{
+  char *p = (char*)buf;
+  size_t len = sizeof(int) * row_size(i);
+  off_t pos = sizeof(int) * offs[i];
+
+  // A large row may be read in several pieces
+  while ( len > 0 ) {
+    ssize_t got = pread( fileno( fp ), p, len, pos );
+    if ( got <= 0 ) {
+      fprintf( stderr, "Cannot read the matrix from the temporary file.\n" );
+      exit( -1 );
+    }
+    p += got;
+    pos += got;
+    len -= got;
+  }
+}
+
+bool
+DiskCsrMatrix::keep_rows( const int* rows, int k )
+{
+  FILE *out = open_temp_file();
+  if ( out == NULL ) return false;
+
+  long *new_offs = new long[k+1];
+  int *buf = new int[m];
+  bool good = true;
+
+  new_offs[0] = 0;
+  for ( int j = 0; j < k && good; ++j ) {
+    int len = row_size( rows[j] );
+    read_row( rows[j], buf );
+    good = ( fwrite( buf, sizeof(int), len, out ) == (size_t)len );
+    new_offs[j+1] = new_offs[j] + len;
+  }
+  delete[] buf;
+
+  if ( !good || fflush( out ) != 0 ) {
+    fclose( out );
+    delete[] new_offs;
+    return false;
+  }
+
+  fclose( fp );
+  fp = out;
+  delete[] offs;
+  offs = new_offs;
+  n = k;
+  return true;
+}
+
+// Feed the row [s, e) to the fingerprint h
+static row_fp_t
+row_fp_feed( row_fp_t h, const int* s, const int* e )
+{
+  h = row_fp_add( h, e - s );
+  for ( ; s < e; ++s )
+    h = row_fp_add( h, (unsigned)*s );
+  return h;
+}
+
+// A 64-bit fingerprint of the row [s, e)
+static row_fp_t
+row_fingerprint( const int* s, const int* e )
+{
+  return row_fp_finish( row_fp_feed( ROW_FP_SEED, s, e ) );
+}
+
+class CsrRowSet : public RowSet
+{
+public:
+  const CsrMatrix *A;
+
+  bool empty( int i ) const
+  {
+    return A->row_size(i) == 0;
+  }
+
+  row_fp_t fingerprint( int i ) const
+  {
+    return row_fingerprint( A->row_begin(i), A->row_end(i) );
+  }
+
+  bool same( int x, int y ) const
+  {
+    int k = A->row_size(x);
+    return k == A->row_size(y) &&
+      memcmp( A->row_begin(x), A->row_begin(y), sizeof(int) * k ) == 0;
+  }
+};
+
+// Row i is paired with row i + half, the pairs are compared as a whole
+class CsrRowPairSet : public CsrRowSet
+{
+public:
+  int half;
+
+  bool empty( int i ) const
+  {
+    return CsrRowSet::empty( i ) && CsrRowSet::empty( i + half );
+  }
+
+  row_fp_t fingerprint( int i ) const
+  {
+    row_fp_t h = row_fp_feed( ROW_FP_SEED, A->row_begin(i), A->row_end(i) );
+    h = row_fp_feed( h, A->row_begin(i+half), A->row_end(i+half) );
+    return row_fp_finish( h );
+  }
+
+  bool same( int x, int y ) const
+  {
+    return CsrRowSet::same( x, y ) && CsrRowSet::same( x + half, y + half );
+  }
+};
+
+int
+compress_equivalent_rows( CsrMatrix* A, int* r_reps, int n_threads )
+{
+  int i;
+
+  // obtain
+  int n = A->n;
+  long *offs = A->offs;
+  int *elems = A->elems;
+
+  CsrRowSet rows;
+  rows.A = A;
+  find_equal_rows( &rows, n, r_reps, n_threads );
+
+  // Now we move the representatives to the front
+  // Since a representative never moves backward, this can be done in place
+  int n_reps = 0;
+  long w = 0;
+  for ( i = 0; i < n; ++i ) {
+    if ( r_reps[i] == i ) {
+      long s = offs[i];
+      long e = offs[i+1];
+      offs[n_reps] = w;
+      memmove( elems + w, elems + s, sizeof(int) * ( e - s ) );
+      w += e - s;
+      r_reps[i] = n_reps++;
+    }
+    else if ( r_reps[i] != -1 ) {
+      // The representative is visited before, its ID has been updated
+      r_reps[i] = r_reps[ r_reps[i] ];
+    }
+  }
+
+  offs[n_reps] = w;
+  A->n = n_reps;
+  return n_reps;
+}
+
+int
+compress_equivalent_row_pairs( CsrMatrix* A, int* r_reps, int n_threads )
+{
+  int i;
+
+  // obtain
+  int half = A->n / 2;
+  long *offs = A->offs;
+  int *elems = A->elems;
+
+  CsrRowPairSet pairs;
+  pairs.A = A;
+  pairs.half = half;
+  find_equal_rows( &pairs, half, r_reps, n_threads );
+
+  // The first halves of the representatives are moved to the front
+  int n_reps = 0;
+  long w = 0;
+  for ( i = 0; i < half; ++i ) {
+    if ( r_reps[i] == i ) {
+      long s = offs[i];
+      long e = offs[i+1];
+      offs[n_reps] = w;
+      memmove( elems + w, elems + s, sizeof(int) * ( e - s ) );
+      w += e - s;
+      r_reps[i] = n_reps++;
+    }
+    else if ( r_reps[i] != -1 )
+      r_reps[i] = r_reps[ r_reps[i] ];
+  }
+
+  // Then the second halves follow in the same order, they never move backward either
+  // A representative takes the next ID, a duplicate refers to an earlier one
+  int k = n_reps;
+  for ( i = 0; i < half; ++i ) {
+    if ( r_reps[i] == k - n_reps ) {
+      long s = offs[i+half];
+      long e = offs[i+half+1];
+      offs[k++] = w;
+      memmove( elems + w, elems + s, sizeof(int) * ( e - s ) );
+      w += e - s;
+    }
+    r_reps[i+half] = ( r_reps[i] == -1 ? -1 : r_reps[i] + n_reps );
+  }
+
+  offs[k] = w;
+  A->n = k;
+  return n_reps;
+}
+
+// The rows on the disk are read into a private buffer, thus the sets can be used by multiple threads
+static row_fp_t
+disk_row_fp_feed( row_fp_t h, const DiskCsrMatrix* A, int i )
+{
+  int k = A->row_size(i);
+  int *buf = new int[k+1];
+  A->read_row( i, buf );
+  h = row_fp_feed( h, buf, buf + k );
+  delete[] buf;
+  return h;
+}
+
+static bool
+same_disk_rows( const DiskCsrMatrix* A, int x, int y )
+{
+  int k = A->row_size(x);
+  if ( k != A->row_size(y) ) return false;
+
+  int *buf = new int[2*k+1];
+  A->read_row( x, buf );
+  A->read_row( y, buf + k );
+  bool same = ( memcmp( buf, buf + k, sizeof(int) * k ) == 0 );
+  delete[] buf;
+  return same;
+}
+
+class DiskRowSet : public RowSet
+{
+public:
+  const DiskCsrMatrix *A;
+
+  bool empty( int i ) const
+  {
+    return A->row_size(i) == 0;
+  }
+
+  row_fp_t fingerprint( int i ) const
+  {
+    return row_fp_finish( disk_row_fp_feed( ROW_FP_SEED, A, i ) );
+  }
+
+  bool same( int x, int y ) const
+  {
+    return same_disk_rows( A, x, y );
+  }
+};
+
+class DiskRowPairSet : public DiskRowSet
+{
+public:
+  int half;
+
+  bool empty( int i ) const
+  {
+    return DiskRowSet::empty( i ) && DiskRowSet::empty( i + half );
+  }
+
+  row_fp_t fingerprint( int i ) const
+  {
+    row_fp_t h = disk_row_fp_feed( ROW_FP_SEED, A, i );
+    return row_fp_finish( disk_row_fp_feed( h, A, i + half ) );
+  }
+
+  bool same( int x, int y ) const
+  {
+    return same_disk_rows( A, x, y ) && same_disk_rows( A, x + half, y + half );
+  }
+};
+
+int
+compress_equivalent_rows( DiskCsrMatrix* A, int* r_reps, int n_threads )
+{
+  int n = A->n;
+
+  DiskRowSet rows;
+  rows.A = A;
+  find_equal_rows( &rows, n, r_reps, n_threads );
+
+  // The representatives are numbered by their first appearances as above
+  int *keep = new int[n];
+  int n_reps = 0;
+  for ( int i = 0; i < n; ++i ) {
+    if ( r_reps[i] == i ) {
+      keep[n_reps] = i;
+      r_reps[i] = n_reps++;
+    }
+    else if ( r_reps[i] != -1 )
+      r_reps[i] = r_reps[ r_reps[i] ];
+  }
+
+  bool good = A->keep_rows( keep, n_reps );
+  delete[] keep;
+  return good ? n_reps : -1;
+}
+
+int
+compress_equivalent_row_pairs( DiskCsrMatrix* A, int* r_reps, int n_threads )
+{
+  int half = A->n / 2;
+
+  DiskRowPairSet pairs;
+  pairs.A = A;
+  pairs.half = half;
+  find_equal_rows( &pairs, half, r_reps, n_threads );
+
+  // The first halves of the representatives, and then their second halves in the same order
+  int *keep = new int[2*half+1];
+  int n_reps = 0;
+  for ( int i = 0; i < half; ++i ) {
+    if ( r_reps[i] == i ) {
+      keep[n_reps] = i;
+      r_reps[i] = n_reps++;
+    }
+    else if ( r_reps[i] != -1 )
+      r_reps[i] = r_reps[ r_reps[i] ];
+  }
+
+  for ( int j = 0; j < n_reps; ++j )
+    keep[n_reps+j] = keep[j] + half;
+  for ( int i = 0; i < half; ++i )
+    r_reps[i+half] = ( r_reps[i] == -1 ? -1 : r_reps[i] + n_reps );
+
+  bool good = A->keep_rows( keep, 2 * n_reps );
+  delete[] keep;
+  return good ? n_reps : -1;
+}
+
+long
+hub_degree( const CsrMatrix* mat_T, int i, const int* r_count )
+{
+  long wt = 0;
+
+  for ( const int *p = mat_T->row_begin(i), *e = mat_T->row_end(i); p < e; ++p ) {
+    // We square the points-to size of x
+    long c = r_count[*p];
+    wt += c * c;
+  }
+
+  return wt;
+}
+
+long
+hub_degree( const DiskCsrMatrix* mat_T, int i, const int* r_count, int* buf )
+{
+  long wt = 0;
+
+  mat_T->read_row( i, buf );
+  for ( int j = 0, k = mat_T->row_size(i); j < k; ++j ) {
+    long c = r_count[ buf[j] ];
+    wt += c * c;
+  }
+
+  return wt;
+}
@@ -0,0 +1,192 @@
+// Copyright 2014, Hong Kong University of Science and Technology. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * A frozen sparse 0/1 matrix in the compressed sparse row (CSR) format.
+ * The rows are only iterated in order, so a flat array is much cheaper than the linked-list bitmaps:
+ * 4 bytes per set bit, and the bits of a row are contiguous in memory.
+ */
+
+#ifndef CSR_MATRIX_H
+#define CSR_MATRIX_H
+
+#include <cstdio>
+#include "row-hash.hh"
+
+class ExternalSorter;
+
+class CsrMatrix
+{
+public:
+  int n, m;                 // #rows, #columns
+  long *offs;               // row i occupies elems[offs[i], offs[i+1])
+  int *elems;               // the column IDs, strictly ascending in every row
+
+public:
+  CsrMatrix( int row, int col )
+  {
+    n = row; m = col;
+    offs = new long[row+1];
+    offs[0] = 0;
+    elems = NULL;
+  }
+
+  ~CsrMatrix()
+  {
+    delete[] offs;
+    if ( elems != NULL ) delete[] elems;
+  }
+
+  long size() const
+  {
+    return offs[n];
+  }
+
+  int row_size( int i ) const
+  {
+    return offs[i+1] - offs[i];
+  }
+
+  const int* row_begin( int i ) const
+  {
+    return elems + offs[i];
+  }
+
+  const int* row_end( int i ) const
+  {
+    return elems + offs[i+1];
+  }
+
+  // Remove the duplicated columns, the columns of every row must be already sorted
+  void remove_duplicates();
+};
+
+/*
+ * Collects a matrix row by row and produces its transpose.
+ * Only the column IDs are buffered, so the transposition costs 8 bytes per fact at peak.
+ *
+ * With hash consing, every column carries a rolling fingerprint of the rows appended to it.
+ * The equal columns are then detected before the transpose is materialized,
+ * and only the distinct columns are stored, which cuts the peak memory if many columns are equal.
+ */
+class CsrTransposer
+{
+public:
+  CsrTransposer( int row, int col, bool hash_consing = false );
+  ~CsrTransposer();
+
+  // Append the next row, every column is shifted by shift
+  void append_row( const int* cols, int k, int shift = 0 );
+
+  // Produce the transpose, the rows in every column are ascending and unique
+  // The collected rows are released
+  CsrMatrix* transpose();
+
+  /*
+   * Produce the transpose with only the distinct non-empty columns, hash consing must be enabled.
+   * The result is the same as calling compress_equivalent_rows on the output of transpose().
+   */
+  CsrMatrix* transpose_distinct( int* c_reps );
+
+private:
+  void release();
+
+private:
+  int n, m;
+  int n_rows;               // #rows appended so far
+  int *row_lens;
+  long *col_lens;
+  int *cols;                // the columns of the appended rows
+  long n_cols, cap;
+  // Hash consing only
+  row_fp_t *col_fps;        // the fingerprints of the columns
+  int *last_row;            // the last row appended to every column
+};
+
+/*
+ * A CsrMatrix whose elements are kept in a temporary file, only the row offsets stay in memory.
+ * The elements are added in any order and sorted by an ExternalSorter under a memory budget,
+ * so the peak memory does not grow with the number of elements, e.g. the transpose is built by add( c, r ).
+ * Every row is read back with one pread, so the rows can be read by multiple threads.
+ */
+class DiskCsrMatrix
+{
+public:
+  int n, m;                 // #rows, #columns
+  long *offs;               // row i occupies the ints [offs[i], offs[i+1]) of the file
+
+public:
+  // budget is the number of bytes for sorting the facts
+  DiskCsrMatrix( int row, int col, long budget );
+  ~DiskCsrMatrix();
+
+  // Append the element c to row r, returns false if the facts cannot be spilled
+  bool add( int r, int c );
+
+  // No more elements, the rows are written to the file with duplicates removed
+  // Returns false if the file cannot be written
+  bool freeze();
+
+  long size() const
+  {
+    return offs[n];
+  }
+
+  int row_size( int i ) const
+  {
+    return offs[i+1] - offs[i];
+  }
+
+  // Read row i into buf, which has room for row_size(i) ints
+  // The program exits if the file cannot be read, since the rows are read deep in the building
+  void read_row( int i, int* buf ) const;
+
+  // Keep only the rows rows[0..k) in this order, returns false if the file cannot be written
+  bool keep_rows( const int* rows, int k );
+
+private:
+  ExternalSorter *facts;    // the (row, element) pairs before freezing
+  std::FILE *fp;
+};
+
+/*
+ * We merge the equal rows.
+ * r_reps[i] receives the new ID of row i, or -1 if row i is empty.
+ * The representative rows are moved to the front by the order of their first appearances.
+ * Returns the number of representatives.
+ * The result does not depend on n_threads.
+ */
+extern int
+compress_equivalent_rows( CsrMatrix*, int* r_reps, int n_threads = 1 );
+
+/*
+ * Same as above, but row i and row i + n/2 are merged together as a pair.
+ * Two pairs are equal only if both of their halves are equal.
+ * The first halves of the representative pairs are moved to the front, and then the second halves in the same order.
+ * r_reps[i] and r_reps[i + n/2] receive the new IDs of the two rows, or -1 if both rows are empty.
+ * Returns the number of representative pairs.
+ */
+extern int
+compress_equivalent_row_pairs( CsrMatrix*, int* r_reps, int n_threads = 1 );
+
+// The same as above for the matrices on the disk, the representatives are copied to a new file
+// Returns -1 if the file cannot be written
+extern int
+compress_equivalent_rows( DiskCsrMatrix*, int* r_reps, int n_threads = 1 );
+
+extern int
+compress_equivalent_row_pairs( DiskCsrMatrix*, int* r_reps, int n_threads = 1 );
+
+/*
+ * The hub degree of row i of the transposed matrix mat_T.
+ * It is the sum of the squared row sizes (r_count) of the original matrix over the elements of row i.
+ */
+extern long
+hub_degree( const CsrMatrix* mat_T, int i, const int* r_count );
+
+// The same as above, buf has room for the row
+extern long
+hub_degree( const DiskCsrMatrix* mat_T, int i, const int* r_count, int* buf );
+
+#endif
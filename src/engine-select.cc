@@ -0,0 +1,331 @@
+// Copyright 2014, Hong Kong University of Science and Technology. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * The statistics pass and the cost model for choosing the index engine.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include "engine-select.hh"
+#include "csr-matrix.hh"
+#include "constants.hh"
+#include "profile_helper.h"
+
+using namespace std;
+
+// The cost model, calibrated with pesI and bitI on our benchmarks
+#define BLOCK_BITS 128.0        // bits of a bitmap block
+#define BLOCK_BYTES 20.0        // the block index and its bits
+#define LABEL_BYTES 4.0         // a Pestrie label
+#define NS_PER_FIGURE 1100.0    // generating and indexing a Pestrie figure
+#define NS_PER_FACT 200.0       // building the Pestrie trees
+#define NS_PER_PAIR 11.0        // the bitmap multiplication per (row, column) pair
+#define NS_PER_BLOCK 250.0      // producing a block of the alias matrix
+
+// The predicted sizes within this ratio are considered equal
+#define SIZE_SLACK 1.25
+// The share of the objects taken as the hubs
+#define HUB_RATIO 0.01
+
+typedef unsigned long long fingerprint_t;
+
+static const char* engine_names[] = { "Pestrie", "Bitmap" };
+
+struct HubGreater
+{
+  const long *wt;
+  bool operator()( int a, int b ) const { return wt[a] > wt[b]; }
+};
+
+// Extend the fingerprint of a pointer by object o, 0 means the pointer is not in any tree
+static fingerprint_t
+extend_fingerprint( fingerprint_t x, int o )
+{
+  x ^= ( (fingerprint_t)o + 1 ) * 0x9E3779B97F4A7C15ULL;
+  x ^= x >> 30; x *= 0xBF58476D1CE4E5B9ULL;
+  x ^= x >> 27; x *= 0x94D049BB133111EBULL;
+  x ^= x >> 31;
+  return x == 0 ? 1 : x;
+}
+
+// The expected #distinct outcomes of drawing k times from n choices
+static double
+expected_distinct( double k, double n )
+{
+  if ( n < 1.0 ) n = 1.0;
+  return n * ( 1.0 - exp( -k / n ) );
+}
+
+EngineEstimate::EngineEstimate()
+{
+  n_rows = m_objs = 0;
+  n_facts = n_cross = 0;
+  hub_share = 0.0;
+  n_figures = n_merged = pes_size = pes_time = 0.0;
+  n_alias_pairs = n_blocks = bit_size = bit_time = 0.0;
+  engine = ENGINE_PESTRIE;
+  reason[0] = 0;
+
+  long row_scales[] = { 3, 7, 17, 45 };
+  row_skew.push_scales( row_scales, 4 );
+  long obj_scales[] = { 3, 20, 80, 200 };
+  hub_skew.push_scales( obj_scales, 4 );
+}
+
+void
+EngineEstimate::print( FILE* fp )
+{
+  fprintf( fp, "\n-----------Engine Selection-------------\n" );
+  show_res_use( "Statistics" );
+  fprintf( fp, "Distinct rows = %d, Objects = %d, Facts = %ld\n", n_rows, m_objs, n_facts );
+  fprintf( fp, "The top %.0lf%% objects hold %.2lf%% of the hub degrees\n", HUB_RATIO * 100, hub_share * 100 );
+  row_skew.print_result( fp, "Row size distribution", false );
+  hub_skew.print_result( fp, "Object size distribution", false );
+  fprintf( fp, "Pestrie : Cross Edges = %ld, Figures = %.0lf (%.0lf after merging), predicted size = %.0lfKb, time = %.0lfms\n",
+	   n_cross, n_figures, n_merged, pes_size / 1024, pes_time * 1000 );
+  fprintf( fp, "Bitmap : Alias pairs = %.0lf, Blocks = %.0lf, predicted size = %.0lfKb, time = %.0lfms\n",
+	   n_alias_pairs, n_blocks, bit_size / 1024, bit_time * 1000 );
+  fprintf( fp, "Choose %s: %s\n", engine_names[engine], reason );
+}
+
+/*
+ * Sort and merge the rows of the snapshot, the load rows are shifted by m.
+ * Returns the transposed matrix of the distinct rows, one row per (shifted) object.
+ */
+static CsrMatrix*
+distinct_rows_transposed( const MatrixSnapshot* snap, CsrMatrix** p_rows )
+{
+  int n = snap->n;
+  int m = snap->m;
+  bool dual = ( snap->matrix_type == SE_MATRIX );
+  int mm = dual ? m + m : m;
+
+  CsrTransposer *tr = new CsrTransposer( n, mm );
+  for ( int i = 0; i < n; ++i ) {
+    int shift = ( dual && snap->types[i] == SE_LOAD ) ? m : 0;
+    tr->append_row( snap->cols + snap->offs[i], snap->offs[i+1] - snap->offs[i], shift );
+  }
+  CsrMatrix *cols_T = tr->transpose();
+  delete tr;
+
+  // Transposing twice sorts the rows
+  tr = new CsrTransposer( mm, n );
+  for ( int i = 0; i < mm; ++i )
+    tr->append_row( cols_T->row_begin(i), cols_T->row_size(i) );
+  delete cols_T;
+  CsrMatrix *rows = tr->transpose();
+  delete tr;
+
+  int *r_reps = new int[n];
+  int n_reps = compress_equivalent_rows( rows, r_reps );
+  delete[] r_reps;
+
+  tr = new CsrTransposer( n_reps, mm );
+  for ( int i = 0; i < n_reps; ++i )
+    tr->append_row( rows->row_begin(i), rows->row_size(i) );
+  CsrMatrix *mat_T = tr->transpose();
+  delete tr;
+
+  *p_rows = rows;
+  return mat_T;
+}
+
+// Simulate the Pestrie trees in the hub degree order
+static void
+estimate_pestrie( const CsrMatrix* mat_T, int m, bool dual, const int* order, EngineEstimate* est )
+{
+  int n = mat_T->m;
+  fingerprint_t *fps = new fingerprint_t[n];
+  fingerprint_t *keys = new fingerprint_t[n];
+  memset( fps, 0, sizeof(fingerprint_t) * n );
+
+  long n_cross = 0;
+  double n_pairs = 0.0;
+
+  for ( int i = 0; i < m; ++i ) {
+    int o = order[i];
+    int k = 0;
+
+    for ( int h = o; h < mat_T->n; h += m ) {
+      for ( const int *p = mat_T->row_begin(h), *e = mat_T->row_end(h); p < e; ++p )
+	if ( fps[*p] != 0 ) keys[k++] = fps[*p];
+      if ( !dual ) break;
+    }
+
+    // Every group of the pointers already in the trees is reached by a cross edge
+    sort( keys, keys + k );
+    long x = unique( keys, keys + k ) - keys;
+    n_cross += x;
+    n_pairs += x * ( x + 1 ) / 2.0;
+
+    for ( int h = o; h < mat_T->n; h += m ) {
+      for ( const int *p = mat_T->row_begin(h), *e = mat_T->row_end(h); p < e; ++p )
+	fps[*p] = extend_fingerprint( fps[*p], o );
+      if ( !dual ) break;
+    }
+  }
+
+  delete[] fps;
+  delete[] keys;
+
+  // The figures covering the same alias pairs are merged
+  double figures = est->n_alias_pairs;
+  if ( figures > 0 )
+    figures = expected_distinct( n_pairs, figures );
+
+  est->n_cross = n_cross;
+  est->n_figures = n_pairs;
+  est->n_merged = figures;
+  est->pes_size = LABEL_BYTES * ( est->n_rows + est->m_objs + n_cross + figures );
+  est->pes_time = ( NS_PER_FIGURE * n_pairs + NS_PER_FACT * est->n_facts ) * 1e-9;
+}
+
+// Estimate the alias (or store-store and store-load conflict) matrices of the bitmap index
+static void
+estimate_bitmap( const CsrMatrix* rows, const CsrMatrix* mat_T, int m, bool dual, EngineEstimate* est )
+{
+  int n = rows->n;
+  int n_stores = 0;
+  int n_loads = 0;
+
+  for ( int i = 0; i < n; ++i ) {
+    // The loads are shifted to the second half
+    if ( dual && rows->row_size(i) > 0 && *rows->row_begin(i) >= m ) ++n_loads;
+    else ++n_stores;
+  }
+
+  double mult = 0.0;
+  for ( int i = 0; i < m; ++i ) {
+    double st = mat_T->row_size(i);
+    double ld = dual ? mat_T->row_size(i+m) : 0;
+    mult += st * ( st + ld );
+  }
+
+  double alias = 0.0;
+  double alias_blocks = 0.0;
+  double blocks = 0.0;
+  double w_obj = m / BLOCK_BITS;
+
+  for ( int i = 0; i < n; ++i ) {
+    double k = rows->row_size(i);
+    blocks += expected_distinct( k, w_obj );
+    if ( dual && k > 0 && *rows->row_begin(i) >= m ) continue;
+
+    // The pointers sharing the objects with row i
+    double s_st = 0, s_ld = 0;
+    for ( const int *p = rows->row_begin(i), *e = rows->row_end(i); p < e; ++p ) {
+      s_st += mat_T->row_size(*p);
+      if ( dual ) s_ld += mat_T->row_size(*p + m);
+    }
+
+    double a = expected_distinct( s_st, n_stores );
+    alias += a / 2;
+    alias_blocks += expected_distinct( a, n_stores / BLOCK_BITS );
+
+    if ( n_loads > 0 ) {
+      a = expected_distinct( s_ld, n_loads );
+      alias += a;
+      alias_blocks += expected_distinct( a, n_loads / BLOCK_BITS );
+    }
+  }
+
+  blocks += alias_blocks;
+  int n_enc_rows = dual ? n + n_stores : n + n;
+
+  est->n_alias_pairs = alias;
+  est->n_blocks = blocks;
+  est->bit_size = BLOCK_BYTES * blocks + sizeof(int) * ( n_enc_rows + est->n_rows + est->m_objs );
+  est->bit_time = ( NS_PER_PAIR * mult + NS_PER_BLOCK * alias_blocks ) * 1e-9;
+}
+
+static void
+decide( EngineEstimate* est )
+{
+  double pes = est->pes_size;
+  double bit = est->bit_size;
+  int len = 0;
+
+  if ( bit * SIZE_SLACK < pes ) {
+    est->engine = ENGINE_BITMAP;
+    len = sprintf( est->reason, "the bitmap index is predicted to be %.1lfx smaller", pes / bit );
+  }
+  else if ( pes * SIZE_SLACK < bit ) {
+    est->engine = ENGINE_PESTRIE;
+    len = sprintf( est->reason, "the Pestrie index is predicted to be %.1lfx smaller", bit / pes );
+  }
+  else {
+    est->engine = est->pes_time <= est->bit_time ? ENGINE_PESTRIE : ENGINE_BITMAP;
+    len = sprintf( est->reason, "the two indexes are predicted to be similar in size, and %s is faster to build",
+		   engine_names[est->engine] );
+  }
+
+  sprintf( est->reason + len, " (the top %.0lf%% objects hold %.1lf%% of the hub degrees, %.1lf figures per cross edge)",
+	   HUB_RATIO * 100, est->hub_share * 100,
+	   est->n_cross == 0 ? 0.0 : est->n_merged / est->n_cross );
+}
+
+EngineEstimate*
+select_engine( const MatrixSnapshot* snap )
+{
+  int m = snap->m;
+  bool dual = ( snap->matrix_type == SE_MATRIX );
+
+  CsrMatrix *rows = NULL;
+  CsrMatrix *mat_T = distinct_rows_transposed( snap, &rows );
+  int n = rows->n;
+
+  EngineEstimate *est = new EngineEstimate;
+  est->n_rows = n;
+  est->m_objs = m;
+  est->n_facts = rows->size();
+
+  int *r_count = new int[n];
+  for ( int i = 0; i < n; ++i ) {
+    r_count[i] = rows->row_size(i);
+    est->row_skew.add_sample( r_count[i] );
+  }
+
+  // The same weights used by Pestrie for ordering the objects
+  long *wt = new long[m];
+  int *order = new int[m];
+  double tot_wt = 0.0;
+
+  for ( int i = 0; i < m; ++i ) {
+    wt[i] = hub_degree( mat_T, i, r_count );
+    int sz = mat_T->row_size(i);
+    if ( dual ) {
+      wt[i] += hub_degree( mat_T, i + m, r_count );
+      sz += mat_T->row_size(i+m);
+    }
+    est->hub_skew.add_sample( sz );
+    tot_wt += wt[i];
+    order[i] = i;
+  }
+
+  HubGreater cmp;
+  cmp.wt = wt;
+  stable_sort( order, order + m, cmp );
+
+  int n_hubs = m * HUB_RATIO;
+  if ( n_hubs < 1 ) n_hubs = 1;
+  double hub_wt = 0.0;
+  for ( int i = 0; i < n_hubs && i < m; ++i )
+    hub_wt += wt[order[i]];
+  est->hub_share = tot_wt > 0 ? hub_wt / tot_wt : 0.0;
+
+  estimate_bitmap( rows, mat_T, m, dual, est );
+  estimate_pestrie( mat_T, m, dual, order, est );
+  decide( est );
+
+  delete[] r_count;
+  delete[] wt;
+  delete[] order;
+  delete rows;
+  delete mat_T;
+
+  return est;
+}
@@ -0,0 +1,63 @@
+// Copyright 2014, Hong Kong University of Science and Technology. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * Choosing between Pestrie and the bitmap index before building either of them.
+ * Pestrie wins only if the input matrix is skewed, i.e. a few hub objects are pointed to by the most pointers.
+ * A statistics pass over the input predicts the index size and the build time of both engines:
+ * 1. Pestrie: the trees are simulated with the hub degree order, every pointer carries the fingerprint of the objects visited so far.
+ *    The distinct fingerprints in a column are the cross edges to that object, and pairing them produces the index figures;
+ * 2. Bitmap: the alias matrix is estimated by assuming the objects are independent,
+ *    and every 128-bit block costs 20 bytes in the index file.
+ * The predictions are rough, we only expect them to rank the two engines correctly.
+ */
+
+#ifndef ENGINE_SELECT_H
+#define ENGINE_SELECT_H
+
+#include "histogram.hh"
+#include "matrix-io.hh"
+
+#define ENGINE_PESTRIE 0
+#define ENGINE_BITMAP 1
+
+class EngineEstimate
+{
+public:
+  // Statistics of the input matrix
+  int n_rows;               // #distinct non-empty rows
+  int m_objs;               // #objects
+  long n_facts;             // #facts of the distinct rows
+  double hub_share;         // the share of the hub degrees held by the top 1% objects
+  histogram row_skew;       // the distribution of the row sizes
+  histogram hub_skew;       // the distribution of the objects sizes
+
+  // Pestrie
+  long n_cross;             // #cross edges
+  double n_figures;         // #figures generated before merging
+  double n_merged;          // #figures left after merging, counted in pes_size
+  double pes_size;          // bytes
+  double pes_time;          // seconds
+
+  // Bitmap
+  double n_alias_pairs;     // #alias (or conflict) pairs
+  double n_blocks;          // #bitmap blocks of all the encoded matrices
+  double bit_size;
+  double bit_time;
+
+  // The decision
+  int engine;
+  char reason[512];
+
+public:
+  EngineEstimate();
+
+  void print( FILE* fp );
+};
+
+// Collect the statistics of the snapshot and choose the engine, the caller deletes the estimate
+extern EngineEstimate*
+select_engine( const MatrixSnapshot* snap );
+
+#endif
@@ -0,0 +1,208 @@
+// Copyright 2014, Hong Kong University of Science and Technology. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * Implementation of the external merge sort.
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include <unistd.h>
+#include "ext-sort.hh"
+
+using namespace std;
+
+// The runs are collapsed into one when there are too many of them
+#define MAX_RUNS 64
+// The stdio buffer for every run
+#define RUN_BUFFER (1 << 20)
+
+typedef pair<sort_key_t, int> run_head_t;
+
+FILE*
+open_temp_file()
+{
+  const char *dir = getenv( "TMPDIR" );
+  if ( dir == NULL || dir[0] == 0 ) dir = "/tmp";
+
+  char *path = new char[ strlen(dir) + 32 ];
+  sprintf( path, "%s/pestrie-sort-XXXXXX", dir );
+
+  FILE *fp = NULL;
+  int fd = mkstemp( path );
+  if ( fd != -1 ) {
+    // The file is removed as soon as it is closed
+    unlink( path );
+    fp = fdopen( fd, "w+b" );
+    if ( fp == NULL ) close( fd );
+    else setvbuf( fp, NULL, _IOFBF, RUN_BUFFER );
+  }
+
+  delete[] path;
+  return fp;
+}
+
+// Sort and deduplicate a[0, size), returns the new size
+static long
+sort_unique( sort_key_t* a, long size )
+{
+  sort( a, a + size );
+  return unique( a, a + size ) - a;
+}
+
+ExternalSorter::ExternalSorter( long budget )
+{
+  max_cap = budget / sizeof(sort_key_t);
+  if ( max_cap < 1024 ) max_cap = 1024;
+
+  // The buffer grows on demand, so a small input does not take the whole budget
+  cap = 1024;
+  buf = new sort_key_t[cap];
+  size = pos = 0;
+  has_last = false;
+  n_spills = 0;
+}
+
+ExternalSorter::~ExternalSorter()
+{
+  if ( buf != NULL ) delete[] buf;
+  for ( size_t i = 0; i < runs.size(); ++i )
+    fclose( runs[i] );
+}
+
+bool
+ExternalSorter::add( sort_key_t key )
+{
+  if ( size == cap ) {
+    if ( cap < max_cap ) {
+      long new_cap = cap * 2;
+      if ( new_cap > max_cap ) new_cap = max_cap;
+      sort_key_t *b = new sort_key_t[new_cap];
+      memcpy( b, buf, sizeof(sort_key_t) * size );
+      delete[] buf;
+      buf = b;
+      cap = new_cap;
+    }
+    else if ( !spill() )
+      return false;
+  }
+
+  buf[size++] = key;
+  return true;
+}
+
+// Write the buffered keys as a sorted run
+bool
+ExternalSorter::spill()
+{
+  size = sort_unique( buf, size );
+
+  FILE *fp = open_temp_file();
+  if ( fp == NULL ) return false;
+  runs.push_back( fp );
+  ++n_spills;
+
+  bool good = ( fwrite( buf, sizeof(sort_key_t), size, fp ) == (size_t)size );
+  size = 0;
+  if ( !good ) return false;
+
+  if ( runs.size() >= MAX_RUNS ) return collapse_runs();
+  return true;
+}
+
+// Merge all the runs into a single run
+bool
+ExternalSorter::collapse_runs()
+{
+  FILE *fp = open_temp_file();
+  if ( fp == NULL ) return false;
+
+  start_merge();
+
+  sort_key_t key;
+  bool good = true;
+  while ( good && pop_merged( key ) )
+    good = ( fwrite( &key, sizeof(sort_key_t), 1, fp ) == 1 );
+
+  for ( size_t i = 0; i < runs.size(); ++i )
+    fclose( runs[i] );
+  runs.clear();
+  runs.push_back( fp );
+  return good;
+}
+
+// Read the head of the run into the heap
+void
+ExternalSorter::push_run( int run )
+{
+  sort_key_t key;
+
+  if ( fread( &key, sizeof(sort_key_t), 1, runs[run] ) == 1 ) {
+    heap.push_back( run_head_t( key, run ) );
+    push_heap( heap.begin(), heap.end(), greater<run_head_t>() );
+  }
+}
+
+void
+ExternalSorter::start_merge()
+{
+  heap.clear();
+  has_last = false;
+
+  for ( size_t i = 0; i < runs.size(); ++i ) {
+    fflush( runs[i] );
+    rewind( runs[i] );
+    push_run( i );
+  }
+}
+
+// The duplicates across the runs are skipped
+bool
+ExternalSorter::pop_merged( sort_key_t& key )
+{
+  while ( heap.size() > 0 ) {
+    pop_heap( heap.begin(), heap.end(), greater<run_head_t>() );
+    run_head_t h = heap.back();
+    heap.pop_back();
+    push_run( h.second );
+
+    if ( has_last && h.first == last ) continue;
+    has_last = true;
+    last = key = h.first;
+    return true;
+  }
+
+  return false;
+}
+
+bool
+ExternalSorter::finish()
+{
+  if ( runs.size() == 0 ) {
+    // Everything fits in the memory
+    size = sort_unique( buf, size );
+    pos = 0;
+    return true;
+  }
+
+  if ( size > 0 && !spill() ) return false;
+  delete[] buf;
+  buf = NULL;
+  start_merge();
+  return true;
+}
+
+bool
+ExternalSorter::next( sort_key_t& key )
+{
+  if ( buf != NULL ) {
+    if ( pos == size ) return false;
+    key = buf[pos++];
+    return true;
+  }
+
+  return pop_merged( key );
+}
@@ -0,0 +1,63 @@
+// Copyright 2014, Hong Kong University of Science and Technology. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * Sorting and deduplicating 64-bit keys under a memory budget.
+ * The keys are sorted in memory if they fit in the budget.
+ * Otherwise, the sorted runs are spilled to temporary files and merged on the fly.
+ * The temporary files are put in $TMPDIR (or /tmp), and they are removed automatically.
+ */
+
+#ifndef EXT_SORT_H
+#define EXT_SORT_H
+
+#include <cstdio>
+#include <vector>
+
+typedef unsigned long long sort_key_t;
+
+// Create an anonymous temporary file in $TMPDIR (or /tmp), it is removed once closed
+extern FILE* open_temp_file();
+
+class ExternalSorter
+{
+public:
+  // budget is the number of bytes used for buffering the keys
+  ExternalSorter( long budget );
+  ~ExternalSorter();
+
+  // Returns false if the keys cannot be spilled to the disk
+  bool add( sort_key_t key );
+
+  // No more keys, prepare for reading the sorted keys
+  bool finish();
+
+  // Fetch the next distinct key in ascending order, returns false at the end
+  bool next( sort_key_t& key );
+
+  // #runs spilled to the disk
+  int n_spilled() const { return n_spills; }
+
+private:
+  bool spill();
+  bool collapse_runs();
+  void start_merge();
+  bool pop_merged( sort_key_t& key );
+  void push_run( int run );
+
+private:
+  sort_key_t *buf;
+  long size, cap, max_cap;
+  // The read position in buf after finish() (in-memory case)
+  long pos;
+  // The spilled runs
+  std::vector<FILE*> runs;
+  // A min-heap of the run heads during merging
+  std::vector< std::pair<sort_key_t, int> > heap;
+  bool has_last;
+  sort_key_t last;
+  int n_spills;
+};
+
+#endif
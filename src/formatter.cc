@@ -4,6 +4,7 @@
 
 /*
  * Converts textual matrix input to binary format.
+ * The output is the binary CSR matrix described in matrix-io.hh, which is accepted by pesI and bitI.
  * By Xiao Xiao
  * initial: 2014.2
  */
@@ -11,8 +12,9 @@
 #include <cstdio>
 #include <unistd.h>
 #include <cstdlib>
-#include "matrix_ops.hh"
-#include "options.h"
+#include "constants.hh"
+#include "matrix-io.hh"
+#include "profile_helper.h"
 
 using namespace std;
 
@@ -22,12 +24,12 @@ const char* input_file = NULL;
 const char* output_file = NULL;
 
 
-static bool 
+static bool
 parse_options( int argc, char **argv )
 {
   int c;
 
-  while ( (c = getopt( argc, argv, "e:" ) ) != -1 ) {
+  while ( (c = getopt( argc, argv, "e:F:" ) ) != -1 ) {
     switch ( c ) {
     case 'e':
       matrix_type = atoi( optarg );
@@ -36,7 +38,7 @@ parse_options( int argc, char **argv )
     case 'F':
       input_format = atoi( optarg );
       break;
-      
+
     default:
       printf( "This program doesn't support this argument.\n" );
       break;
@@ -51,7 +53,9 @@ parse_options( int argc, char **argv )
     fprintf( stderr, "       1 : Side-effect matrix.\n" );
     fprintf( stderr, "-F       : Specify the format of the input file\n" );
     fprintf( stderr, "       0 : Each line starts with the number of the following elements (default);\n" );
-    fprintf( stderr, "       1 : Each line ends with -1.\n" );
+    fprintf( stderr, "       1 : Each line ends with -1;\n" );
+    fprintf( stderr, "       3 : Unsorted edge list, one (pointer, object) pair per line.\n" );
+    fprintf( stderr, "The input_file can be - for reading the matrix from the standard input.\n" );
     return false;
   }
 
@@ -67,58 +71,33 @@ parse_options( int argc, char **argv )
 }
 
 
-Cmatrix*
-read_points_to_input()
-{
-  int i, k;
-  int n, m;
-  int dst;
-
-  FILE* fp = fopen( input_file, "r" );
-
-  __init_matrix_lib();
-  fscanf( fp, "%d %d", &n, &m );
-
-  // create
-  Cmatrix *ptm = new Cmatrix( n, m );
-  bitmap *mat = ptm->mat;
-
-  for ( i = 0; i < n; ++i ) {
-    if ( input_format == INPUT_START_BY_SIZE ) {
-      fscanf( fp, "%d", &k );
-    }
-    else
-      // set a large value to k
-      k = ((unsigned)(-1)>>1);
-    
-    while ( k > 0 ) {
-      fscanf( fp, "%d", &dst );
-      if ( input_format == INPUT_END_BY_MINUS_ONE ) {
-	if ( dst == -1 ) 
-	  break;
-      }
-      
-      k--;
-      bitmap_set_bit( mat[i], dst );
-    }
-  }
-  
-  fclose(fp);
-  return ptm;
-}
-
-
 int main(int argc, char** argv)
 {
   if ( parse_options(argc, argv) == false )
     return -1;
 
-  Cmatrix* ptm = read_points_to_input();
+  MatrixReader* reader = open_matrix_reader( input_file, matrix_type, input_format );
+  if ( reader == NULL ) {
+    fprintf( stderr, "Loading file failed.\n" );
+    return -1;
+  }
+
   FILE* out_fp = fopen( output_file, "wb" );
-  //compress_equivalent_rows(ptm);
-  serialize_out( ptm, out_fp );
+  if ( out_fp == NULL ) {
+    fprintf( stderr, "Cannot write to the file: %s\n", output_file );
+    delete reader;
+    return -1;
+  }
+
+  bool good = write_binary_matrix( reader, out_fp );
   fclose(out_fp);
-  delete ptm;
+  delete reader;
+
+  if ( !good ) {
+    fprintf( stderr, "Conversion failed.\n" );
+    return -1;
+  }
 
+  show_res_use( "Conversion" );
   return 0;
 }
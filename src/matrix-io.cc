@@ -0,0 +1,1487 @@
+// Copyright 2014, Hong Kong University of Science and Technology. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * Implementation of the input matrix readers.
+ * A regular input file is mapped into memory, and the binary matrix is then used in place.
+ * Pipes and compressed files are consumed as streams while the data arrive.
+ * The textual matrix is decoded by a hand-written scanner, no libc call is made per token.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "matrix-io.hh"
+#include "parallel.hh"
+#include "byte-stream.hh"
+#include "ext-sort.hh"
+
+using namespace std;
+
+typedef long long offset_t;
+
+// Size of the fixed part of the binary header
+#define BINARY_HEADER_SIZE ( 4 + sizeof(int) * 3 + sizeof(offset_t) )
+
+
+// The window of the streamed text
+#define STREAM_WINDOW (1 << 20)
+
+/*
+ * Decoding integers from a piece of text.
+ * The text is either entirely in memory, or streamed through a window that is refilled on demand.
+ */
+struct TextScanner
+{
+  const char *cur, *end;
+  // Set when a non-number is encountered
+  bool broken;
+  // The source and the window of the streamed text (NULL if in memory)
+  ByteStream *stream;
+  char *window;
+  // #bytes dropped from the window, for error reporting
+  long dropped;
+
+  TextScanner( const char* s, const char* e )
+  {
+    cur = s;
+    end = e;
+    broken = false;
+    stream = NULL;
+    window = NULL;
+    dropped = 0;
+  }
+
+  // The first len bytes, which are already taken from the stream, are put back
+  TextScanner( ByteStream* bs, const char* prefix, size_t len )
+  {
+    window = new char[STREAM_WINDOW];
+    memcpy( window, prefix, len );
+    cur = window;
+    end = window + len;
+    broken = false;
+    stream = bs;
+    dropped = 0;
+  }
+
+  ~TextScanner()
+  {
+    if ( window != NULL ) delete[] window;
+  }
+
+  // The unconsumed text is moved to the front and the window is filled up
+  // Returns false if nothing more is read
+  bool refill()
+  {
+    size_t left = end - cur;
+    dropped += cur - window;
+    memmove( window, cur, left );
+    size_t got = stream->read( window + left, STREAM_WINDOW - left );
+    cur = window;
+    end = window + left + got;
+    return got > 0;
+  }
+
+  // The position of the scanner in the whole text
+  long offset( const char* base )
+  {
+    return stream == NULL ? cur - base : dropped + ( cur - window );
+  }
+
+  // Skip the blanks, returns true if nothing is left
+  bool at_end()
+  {
+    const char *p = cur;
+
+    while ( true ) {
+      const char *e = end;
+      while ( p < e &&
+	      ( *p == ' ' || *p == '\n' || *p == '\t' || *p == '\r' ) )
+	++p;
+      
+      cur = p;
+      if ( p < e ) return false;
+      if ( stream == NULL || !refill() ) return true;
+      p = cur;
+    }
+  }
+
+  // Decode the next integer, returns false at the end of the input
+  bool scan_int( int& v )
+  {
+    if ( at_end() ) return false;
+
+    // Make sure the whole integer is in the window
+    if ( stream != NULL && end - cur < 32 ) refill();
+
+    const char *p = cur;
+    const char *e = end;
+
+    bool neg = false;
+    if ( *p == '-' ) {
+      neg = true;
+      ++p;
+    }
+
+    if ( p == e || (unsigned)(*p - '0') > 9 ) {
+      // Not a number
+      broken = true;
+      cur = p;
+      return false;
+    }
+
+    int x = 0;
+    do {
+      x = x * 10 + (*p - '0');
+      ++p;
+    } while ( p < e && (unsigned)(*p - '0') <= 9 );
+
+    cur = p;
+    v = ( neg ? -x : x );
+    return true;
+  }
+};
+
+/*
+ * Decode a row in the textual formats:
+ * Format 0: every line is leaded by a number indicating the number of integers in this row.
+ * Format 1: every line is ended by -1.
+ * For side-effect matrix, every line is further leaded by the store/load flag.
+ */
+static bool
+scan_row( TextScanner& sc, int matrix_type, int input_format, int m,
+	  int* type, VECTOR(int)& row )
+{
+  int k, dst;
+
+  if ( matrix_type == SE_MATRIX ) {
+    // the store/load flag
+    if ( !sc.scan_int( *type ) ) return false;
+  }
+
+  if ( input_format == INPUT_START_BY_SIZE ) {
+    if ( !sc.scan_int( k ) || k < 0 ) return false;
+  }
+  else
+    // the row is terminated by -1
+    k = -1;
+
+  while ( k != 0 ) {
+    if ( !sc.scan_int( dst ) ) return false;
+    if ( dst == -1 ) break;
+    if ( dst < 0 || dst >= m ) return false;
+
+    row.push_back( dst );
+    --k;
+  }
+
+  return true;
+}
+
+
+// Reader for the textual matrix
+class TextMatrixReader : public MatrixReader
+{
+public:
+  // The text is mapped into memory
+  TextMatrixReader( const char* buf, size_t len )
+    : sc( buf, buf + len )
+  {
+    base = buf;
+    size = len;
+    stream = NULL;
+    broken = false;
+  }
+
+  // The text is streamed
+  TextMatrixReader( ByteStream* bs, const char* prefix, size_t len )
+    : sc( bs, prefix, len )
+  {
+    base = NULL;
+    size = 0;
+    stream = bs;
+    broken = false;
+  }
+
+  ~TextMatrixReader()
+  {
+    if ( base != NULL ) munmap( (void*)base, size );
+    if ( stream != NULL ) delete stream;
+  }
+
+  int next_row( int* type, const int** cols );
+  ParsedMatrix* parse_in_parallel( int n_threads, bool bucketed );
+  bool read_header();
+
+protected:
+  friend void parse_chunk( int, void* );
+
+  // Report the position of the broken input
+  void report_broken();
+
+  // The mapped file
+  const char *base;
+  size_t size;
+  // Or the streamed file
+  ByteStream *stream;
+  // The scanning position
+  TextScanner sc;
+  // Buffer for the columns of the current row
+  VECTOR(int) row;
+  // Set when the input is malformed or truncated
+  bool broken;
+};
+
+bool
+TextMatrixReader::read_header()
+{
+  return sc.scan_int( n ) && sc.scan_int( m ) &&
+    n >= 0 && m >= 0;
+}
+
+int
+TextMatrixReader::next_row( int* type, const int** cols )
+{
+  if ( broken ) return -1;
+  row.clear();
+
+  if ( !scan_row( sc, matrix_type, input_format, m, type, row ) ) {
+    report_broken();
+    return -1;
+  }
+
+  *cols = row.begin();
+  return row.size();
+}
+
+void
+TextMatrixReader::report_broken()
+{
+  broken = true;
+  if ( stream != NULL && stream->failed() )
+    fprintf( stderr, "The compressed input is corrupted.\n" );
+  else
+    fprintf( stderr, "The input matrix is malformed at byte %ld.\n", sc.offset( base ) );
+}
+
+
+/*
+ * Reader for the edge list format.
+ * The header "n m" is followed by the facts in arbitrary order, one per line:
+ * "row column" for points-to matrix, or "row flag column" for side-effect matrix.
+ * The facts are sorted by rows and deduplicated before the first row is returned.
+ * The sorting spills to the disk if the facts exceed the memory budget.
+ */
+class EdgeListReader : public TextMatrixReader
+{
+public:
+  EdgeListReader( const char* buf, size_t len, long budget )
+    : TextMatrixReader( buf, len ), sorter( budget )
+  {
+    types = NULL;
+    next = 0;
+    sorted = pending = false;
+  }
+
+  EdgeListReader( ByteStream* bs, const char* prefix, size_t len, long budget )
+    : TextMatrixReader( bs, prefix, len ), sorter( budget )
+  {
+    types = NULL;
+    next = 0;
+    sorted = pending = false;
+  }
+
+  ~EdgeListReader()
+  {
+    if ( types != NULL ) delete[] types;
+  }
+
+  int next_row( int* type, const int** cols );
+
+  // The rows are only known after sorting
+  ParsedMatrix* parse_in_parallel( int /*n_threads*/, bool /*bucketed*/ )
+  {
+    return NULL;
+  }
+
+private:
+  bool sort_facts();
+
+private:
+  ExternalSorter sorter;
+  // The store/load flags of the rows (side-effect matrix only)
+  int *types;
+  // The next row to be returned
+  int next;
+  bool sorted;
+  // The smallest key not consumed yet
+  bool pending;
+  sort_key_t key;
+};
+
+// A fact (r, c) is encoded as a key, such that the keys are sorted by rows and then columns
+bool
+EdgeListReader::sort_facts()
+{
+  int r, c, t;
+
+  sorted = true;
+  if ( matrix_type == SE_MATRIX ) {
+    types = new int[n];
+    memset( types, 0, sizeof(int) * n );
+  }
+
+  while ( !sc.at_end() ) {
+    if ( !sc.scan_int( r ) || r < 0 || r >= n ) {
+      report_broken();
+      return false;
+    }
+
+    if ( matrix_type == SE_MATRIX ) {
+      // The flag must be consistent for the same row
+      if ( !sc.scan_int( t ) ||
+	   ( t != SE_STORE && t != SE_LOAD ) ||
+	   ( types[r] != 0 && types[r] != t ) ) {
+	report_broken();
+	return false;
+      }
+      types[r] = t;
+    }
+
+    if ( !sc.scan_int( c ) || c < 0 || c >= m ) {
+      report_broken();
+      return false;
+    }
+
+    if ( !sorter.add( ( (sort_key_t)r << 32 ) | c ) ) {
+      fprintf( stderr, "Cannot write the temporary files for sorting the edge list.\n" );
+      return false;
+    }
+  }
+
+  if ( stream != NULL && stream->failed() ) {
+    report_broken();
+    return false;
+  }
+
+  if ( !sorter.finish() ) {
+    fprintf( stderr, "Cannot write the temporary files for sorting the edge list.\n" );
+    return false;
+  }
+
+  if ( sorter.n_spilled() > 0 )
+    fprintf( stderr, "The edge list is sorted with %d runs on the disk.\n", sorter.n_spilled() );
+
+  pending = sorter.next( key );
+  return true;
+}
+
+int
+EdgeListReader::next_row( int* type, const int** cols )
+{
+  if ( !sorted && !sort_facts() ) broken = true;
+  if ( broken || next >= n ) return -1;
+
+  row.clear();
+  while ( pending && (int)( key >> 32 ) == next ) {
+    row.push_back( (int)( key & 0xffffffff ) );
+    pending = sorter.next( key );
+  }
+
+  if ( matrix_type == SE_MATRIX )
+    // A row without facts is regarded as a store
+    *type = ( types[next] == 0 ? SE_STORE : types[next] );
+
+  ++next;
+  *cols = row.begin();
+  return row.size();
+}
+
+// Shared by the parsing threads
+struct ParseTask
+{
+  TextMatrixReader *reader;
+  ParsedMatrix *pm;
+  const char **bounds;      // chunk i is the text [bounds[i], bounds[i+1])
+  bool *good;               // chunk i only contains complete rows
+};
+
+void
+parse_chunk( int tid, void* arg )
+{
+  ParseTask *task = (ParseTask*)arg;
+  TextMatrixReader *reader = task->reader;
+  ParsedMatrix *pm = task->pm;
+  RowChunk &chunk = pm->chunks[tid];
+  int n_buckets = pm->n_buckets;
+  bool is_se = ( reader->matrix_type == SE_MATRIX );
+
+  TextScanner sc( task->bounds[tid], task->bounds[tid+1] );
+  VECTOR(int) row;
+  int type = SE_STORE;
+  int n_rows = 0;
+
+  if ( n_buckets > 0 )
+    chunk.buckets = new VECTOR(int)[n_buckets];
+
+  // A row crossing the chunk end fails the scanning
+  while ( !sc.at_end() ) {
+    row.clear();
+    if ( !scan_row( sc, reader->matrix_type, reader->input_format, reader->m, &type, row ) ) {
+      task->good[tid] = false;
+      return;
+    }
+
+    int k = row.size();
+    chunk.lens.push_back( k );
+    if ( is_se ) chunk.types.push_back( type );
+
+    if ( n_buckets > 0 ) {
+      for ( int j = 0; j < k; ++j ) {
+	int c = row[j];
+	VECTOR(int) &bkt = chunk.buckets[ pm->bucket_of(c) ];
+	bkt.push_back( n_rows );
+	bkt.push_back( c );
+      }
+    }
+    else
+      chunk.cols.add_all( row );
+
+    ++n_rows;
+  }
+
+  chunk.n_rows = n_rows;
+  task->good[tid] = true;
+}
+
+/*
+ * We split the text after the header into n_threads pieces at line boundaries.
+ * This requires every row to be written in one line.
+ * Otherwise a row crosses the chunk boundary and we give up.
+ */
+ParsedMatrix*
+TextMatrixReader::parse_in_parallel( int n_threads, bool bucketed )
+{
+  // The streamed text cannot be split
+  if ( broken || stream != NULL || n_threads < 2 ) return NULL;
+
+  const char *s = sc.cur;
+  const char *e = sc.end;
+  size_t len = e - s;
+
+  const char **bounds = new const char*[n_threads+1];
+  bounds[0] = s;
+  for ( int i = 1; i < n_threads; ++i ) {
+    const char *p = s + len / n_threads * i;
+    if ( p < bounds[i-1] ) p = bounds[i-1];
+    while ( p < e && *p != '\n' ) ++p;
+    if ( p < e ) ++p;
+    bounds[i] = p;
+  }
+  bounds[n_threads] = e;
+
+  ParsedMatrix *pm = new ParsedMatrix( n, m, n_threads, bucketed ? n_threads : 0 );
+  bool *good = new bool[n_threads];
+  ParseTask task;
+  task.reader = this;
+  task.pm = pm;
+  task.bounds = bounds;
+  task.good = good;
+
+  parallel_execute( n_threads, parse_chunk, &task );
+
+  // Check and number the rows
+  int n_rows = 0;
+  for ( int i = 0; i < n_threads; ++i ) {
+    if ( !good[i] ) {
+      n_rows = -1;
+      break;
+    }
+    pm->chunks[i].first_row = n_rows;
+    n_rows += pm->chunks[i].n_rows;
+  }
+
+  delete[] bounds;
+  delete[] good;
+
+  if ( n_rows != n ) {
+    // Fall back to the sequential parsing
+    delete pm;
+    return NULL;
+  }
+
+  if ( matrix_type == SE_MATRIX )
+    pm->row_types = new int[n];
+
+  for ( int i = 0; i < n_threads; ++i ) {
+    RowChunk &chunk = pm->chunks[i];
+    if ( chunk.n_rows == 0 ) continue;
+    memcpy( pm->row_lens + chunk.first_row, chunk.lens.begin(), sizeof(int) * chunk.n_rows );
+    if ( pm->row_types != NULL )
+      memcpy( pm->row_types + chunk.first_row, chunk.types.begin(), sizeof(int) * chunk.n_rows );
+  }
+
+  // All the rows are consumed
+  sc.cur = sc.end;
+  return pm;
+}
+
+
+/*
+ * Reader for the binary CSR matrix.
+ * The rows are handed out directly from the mapped file.
+ */
+class BinaryMatrixReader : public MatrixReader
+{
+public:
+  // The matrix is mapped into memory
+  BinaryMatrixReader( const char* buf, size_t len )
+  {
+    base = buf;
+    size = len;
+    stream = NULL;
+    offsets = NULL;
+    types = NULL;
+    columns = NULL;
+    row = NULL;
+    row_cap = 0;
+    next = 0;
+  }
+
+  // The matrix is streamed, the magic number is already consumed
+  BinaryMatrixReader( ByteStream* bs )
+  {
+    base = NULL;
+    size = 0;
+    stream = bs;
+    offsets = NULL;
+    types = NULL;
+    columns = NULL;
+    row = NULL;
+    row_cap = 0;
+    next = 0;
+  }
+
+  ~BinaryMatrixReader()
+  {
+    if ( base != NULL ) munmap( (void*)base, size );
+    if ( stream != NULL ) {
+      // The offsets and types are our own copies
+      if ( offsets != NULL ) delete[] offsets;
+      if ( types != NULL ) delete[] types;
+      delete stream;
+    }
+    if ( row != NULL ) delete[] row;
+  }
+
+  int next_row( int* type, const int** cols );
+  bool read_header();
+
+private:
+  bool read_stream_header();
+  bool check_offsets( offset_t nnz );
+
+private:
+  const char *base;
+  size_t size;
+  ByteStream *stream;
+  const offset_t *offsets;
+  const int *types;
+  const int *columns;
+  // Buffer for the streamed columns of the current row
+  int *row, row_cap;
+  // The next row to be read
+  int next;
+};
+
+// Read exactly len bytes from the stream
+static bool
+read_fully( ByteStream* bs, void* buf, size_t len )
+{
+  char *p = (char*)buf;
+
+  while ( len > 0 ) {
+    size_t got = bs->read( p, len );
+    if ( got == 0 ) return false;
+    p += got;
+    len -= got;
+  }
+
+  return true;
+}
+
+// The offsets must be ascending
+bool
+BinaryMatrixReader::check_offsets( offset_t nnz )
+{
+  if ( offsets[0] != 0 || offsets[n] != nnz ) return false;
+  for ( int i = 0; i < n; ++i )
+    if ( offsets[i] > offsets[i+1] ) return false;
+
+  return true;
+}
+
+bool
+BinaryMatrixReader::read_header()
+{
+  if ( stream != NULL ) return read_stream_header();
+
+  const char *p = base + 4;
+  offset_t nnz;
+
+  if ( size < BINARY_HEADER_SIZE ) return false;
+
+  memcpy( &n, p, sizeof(int) ); p += sizeof(int);
+  memcpy( &m, p, sizeof(int) ); p += sizeof(int) * 2;
+  memcpy( &nnz, p, sizeof(offset_t) ); p += sizeof(offset_t);
+  if ( n < 0 || m < 0 || nnz < 0 ) return false;
+
+  // Check the file is long enough to hold all the sections
+  size_t expected = BINARY_HEADER_SIZE + sizeof(offset_t) * (n+1) + sizeof(int) * nnz;
+  if ( matrix_type == SE_MATRIX ) expected += sizeof(int) * n;
+  if ( size != expected ) return false;
+
+  offsets = (const offset_t*)p;
+  p += sizeof(offset_t) * (n+1);
+  if ( matrix_type == SE_MATRIX ) {
+    types = (const int*)p;
+    p += sizeof(int) * n;
+  }
+  columns = (const int*)p;
+
+  return check_offsets( nnz );
+}
+
+// The offsets and types are loaded, the columns are then streamed row by row
+bool
+BinaryMatrixReader::read_stream_header()
+{
+  int head[3];
+  offset_t nnz;
+
+  if ( !read_fully( stream, head, sizeof(head) ) ||
+       !read_fully( stream, &nnz, sizeof(nnz) ) )
+    return false;
+
+  n = head[0];
+  m = head[1];
+  if ( n < 0 || m < 0 || nnz < 0 ) return false;
+
+  offset_t *offs = new offset_t[n+1];
+  offsets = offs;
+  if ( !read_fully( stream, offs, sizeof(offset_t) * (n+1) ) ) return false;
+
+  if ( matrix_type == SE_MATRIX ) {
+    int *tps = new int[n];
+    types = tps;
+    if ( !read_fully( stream, tps, sizeof(int) * n ) ) return false;
+  }
+
+  return check_offsets( nnz );
+}
+
+int
+BinaryMatrixReader::next_row( int* type, const int** cols )
+{
+  if ( next >= n ) return -1;
+
+  const int *p;
+  int k = offsets[next+1] - offsets[next];
+
+  if ( stream != NULL ) {
+    if ( k > row_cap ) {
+      delete[] row;
+      row_cap = k * 2;
+      row = new int[row_cap];
+    }
+    if ( !read_fully( stream, row, sizeof(int) * k ) ) {
+      if ( stream->failed() )
+	fprintf( stderr, "The compressed input is corrupted.\n" );
+      else
+	fprintf( stderr, "The input matrix is truncated at row %d.\n", next );
+      next = n;
+      return -1;
+    }
+    p = row;
+  }
+  else
+    p = columns + offsets[next];
+
+  for ( int j = 0; j < k; ++j ) {
+    if ( (unsigned)p[j] >= (unsigned)m ) {
+      fprintf( stderr, "The input matrix is malformed at row %d.\n", next );
+      next = n;
+      return -1;
+    }
+  }
+
+  if ( matrix_type == SE_MATRIX ) *type = types[next];
+  *cols = p;
+  ++next;
+  return k;
+}
+
+
+// Reader over a snapshot, the rows are used in place
+class SnapshotReader : public MatrixReader
+{
+public:
+  SnapshotReader( const MatrixSnapshot* snap )
+  {
+    this->snap = snap;
+    next = 0;
+  }
+
+  bool read_header()
+  {
+    n = snap->n;
+    m = snap->m;
+    return true;
+  }
+
+  int next_row( int* type, const int** cols )
+  {
+    if ( next >= n ) return -1;
+
+    long s = snap->offs[next];
+    if ( matrix_type == SE_MATRIX ) *type = snap->types[next];
+    *cols = snap->cols + s;
+    ++next;
+    return snap->offs[next] - s;
+  }
+
+private:
+  const MatrixSnapshot *snap;
+  // The next row to be read
+  int next;
+};
+
+MatrixReader*
+MatrixSnapshot::open_reader() const
+{
+  MatrixReader *reader = new SnapshotReader( this );
+  reader->matrix_type = matrix_type;
+  reader->input_format = INPUT_BINARY_CSR;
+  reader->read_header();
+  return reader;
+}
+
+MatrixSnapshot*
+take_snapshot( MatrixReader* reader )
+{
+  int n = reader->n;
+  int type = 0;
+  const int *row;
+
+  MatrixSnapshot *snap = new MatrixSnapshot;
+  snap->n = n;
+  snap->m = reader->m;
+  snap->matrix_type = reader->matrix_type;
+  snap->offs = new long[n+1];
+  if ( reader->matrix_type == SE_MATRIX ) snap->types = new int[n];
+
+  long size = 0, cap = n + 16;
+  int *cols = new int[cap];
+  snap->offs[0] = 0;
+
+  for ( int i = 0; i < n; ++i ) {
+    int k = reader->next_row( &type, &row );
+    if ( k == -1 ) {
+      delete[] cols;
+      delete snap;
+      return NULL;
+    }
+
+    if ( size + k > cap ) {
+      long new_cap = cap * 2;
+      if ( new_cap < size + k ) new_cap = size + k;
+      int *buf = new int[new_cap];
+      memcpy( buf, cols, sizeof(int) * size );
+      delete[] cols;
+      cols = buf;
+      cap = new_cap;
+    }
+
+    memcpy( cols + size, row, sizeof(int) * k );
+    size += k;
+    snap->offs[i+1] = size;
+    if ( snap->types != NULL ) snap->types[i] = type;
+  }
+
+  snap->cols = cols;
+  return snap;
+}
+
+MatrixSnapshot*
+append_facts( const MatrixSnapshot* snap, MatrixReader* delta, char** touched_rows, char** touched_cols )
+{
+  MatrixSnapshot *more = take_snapshot( delta );
+  if ( more == NULL ) return NULL;
+
+  int n = ( snap->n > more->n ? snap->n : more->n );
+  int m = ( snap->m > more->m ? snap->m : more->m );
+  MatrixSnapshot *res = new MatrixSnapshot;
+  res->n = n;
+  res->m = m;
+  res->matrix_type = snap->matrix_type;
+  res->offs = new long[n+1];
+  res->cols = new int[ snap->offs[snap->n] + more->offs[more->n] ];
+  if ( snap->types != NULL ) res->types = new int[n];
+
+  // stamp[c] == i if column c is in row i
+  int *stamp = new int[m];
+  char *flags = new char[m];
+  char *row_flags = new char[n];
+  memset( stamp, -1, sizeof(int) * m );
+  memset( flags, 0, sizeof(char) * m );
+  memset( row_flags, 0, sizeof(char) * n );
+
+  long size = 0;
+  res->offs[0] = 0;
+  for ( int i = 0; i < n; ++i ) {
+    if ( i < snap->n ) {
+      for ( long j = snap->offs[i]; j < snap->offs[i+1]; ++j ) {
+	int c = snap->cols[j];
+	stamp[c] = i;
+	res->cols[size++] = c;
+      }
+    }
+
+    if ( i < more->n ) {
+      for ( long j = more->offs[i]; j < more->offs[i+1]; ++j ) {
+	int c = more->cols[j];
+	if ( stamp[c] == i ) continue;
+	stamp[c] = i;
+	flags[c] = 1;
+	row_flags[i] = 1;
+	res->cols[size++] = c;
+      }
+    }
+
+    res->offs[i+1] = size;
+    if ( res->types != NULL )
+      res->types[i] = ( i < snap->n ? snap->types[i] : more->types[i] );
+  }
+
+  *touched_rows = row_flags;
+  *touched_cols = flags;
+  delete[] stamp;
+  delete more;
+  return res;
+}
+
+// Returns 1 if buf starts with the magic number of matrix_type, -1 if it is for the other type, 0 otherwise
+static int
+match_magic( const char* buf, size_t len, int matrix_type )
+{
+  const char* magic_number = ( matrix_type == PT_MATRIX ? MATRIX_PT_1 : MATRIX_SE_1 );
+  const char* other_magic = ( matrix_type == PT_MATRIX ? MATRIX_SE_1 : MATRIX_PT_1 );
+
+  if ( len < 4 ) return 0;
+  if ( memcmp( buf, magic_number, 4 ) == 0 ) return 1;
+  if ( memcmp( buf, other_magic, 4 ) == 0 ) {
+    fprintf( stderr, "The input matrix type does not match the -e option.\n" );
+    return -1;
+  }
+  return 0;
+}
+
+static MatrixReader*
+check_header( MatrixReader* reader, ByteStream* bs )
+{
+  if ( reader->read_header() ) return reader;
+
+  if ( bs != NULL && bs->failed() )
+    fprintf( stderr, "The compressed input is corrupted.\n" );
+  else
+    fprintf( stderr, "Cannot read the matrix size from the header.\n" );
+  delete reader;
+  return NULL;
+}
+
+/*
+ * The format is recognized by the first 4 bytes of the stream.
+ * The stream is owned by the reader.
+ */
+static MatrixReader*
+open_stream_reader( ByteStream* bs, int matrix_type, int input_format, long mem_budget, bool piped )
+{
+  char magic[4];
+  size_t len = 0, got;
+
+  while ( len < 4 && ( got = bs->read( magic + len, 4 - len ) ) > 0 )
+    len += got;
+
+  // We cannot look ahead in a pipe, so a compressed pipe is not recognized
+  if ( piped && len >= 3 &&
+       ( memcmp( magic, "BZh", 3 ) == 0 ||
+	 ( (unsigned char)magic[0] == 0x1f && (unsigned char)magic[1] == 0x8b ) ) ) {
+    fprintf( stderr, "Please decompress the piped input first, e.g. with bzcat or zcat.\n" );
+    delete bs;
+    return NULL;
+  }
+
+  int binary = match_magic( magic, len, matrix_type );
+  if ( binary == -1 ) {
+    delete bs;
+    return NULL;
+  }
+
+  MatrixReader *reader = NULL;
+  if ( binary == 1 ) {
+    reader = new BinaryMatrixReader( bs );
+    reader->input_format = INPUT_BINARY_CSR;
+  }
+  else {
+    if ( input_format == INPUT_EDGE_LIST )
+      reader = new EdgeListReader( bs, magic, len, mem_budget );
+    else
+      reader = new TextMatrixReader( bs, magic, len );
+    reader->input_format = input_format;
+  }
+
+  reader->matrix_type = matrix_type;
+  return check_header( reader, bs );
+}
+
+MatrixReader*
+open_matrix_reader( const char* file_name, int matrix_type, int input_format, long mem_budget )
+{
+  struct stat st;
+  int fd;
+
+  // "-" stands for the standard input
+  if ( strcmp( file_name, "-" ) == 0 )
+    fd = dup( STDIN_FILENO );
+  else
+    fd = open( file_name, O_RDONLY );
+  if ( fd == -1 ) return NULL;
+
+  if ( fstat( fd, &st ) == -1 ) {
+    close( fd );
+    return NULL;
+  }
+
+  // Pipes cannot be mapped, we parse the data as soon as the producer writes them
+  if ( !S_ISREG( st.st_mode ) )
+    return open_stream_reader( open_file_stream( fd ), matrix_type, input_format, mem_budget, true );
+
+  if ( st.st_size == 0 ) {
+    close( fd );
+    return NULL;
+  }
+
+  // The compressed file is decompressed by a background thread while we are parsing
+  ByteStream *bs = open_compressed_stream( fd );
+  if ( bs != NULL )
+    return open_stream_reader( bs, matrix_type, input_format, mem_budget, false );
+
+  void *buf = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+  close( fd );
+  if ( buf == MAP_FAILED ) return NULL;
+
+  // We scan the file once from head to tail
+  madvise( buf, st.st_size, MADV_SEQUENTIAL );
+
+  // Recognize the binary matrix by the magic number
+  int binary = match_magic( (const char*)buf, st.st_size, matrix_type );
+  if ( binary == -1 ) {
+    munmap( buf, st.st_size );
+    return NULL;
+  }
+
+  MatrixReader *reader = NULL;
+  if ( binary == 1 ) {
+    reader = new BinaryMatrixReader( (const char*)buf, st.st_size );
+    reader->input_format = INPUT_BINARY_CSR;
+  }
+  else {
+    if ( input_format == INPUT_EDGE_LIST )
+      reader = new EdgeListReader( (const char*)buf, st.st_size, mem_budget );
+    else
+      reader = new TextMatrixReader( (const char*)buf, st.st_size );
+    reader->input_format = input_format;
+  }
+
+  reader->matrix_type = matrix_type;
+  return check_header( reader, NULL );
+}
+
+// Shared by the merging threads
+struct ScatterTask
+{
+  ParsedMatrix *pm;
+  bitmap *store_T, *load_T, *mat;
+  const int *row_ids;
+  bitmap_obstack *obstacks;
+};
+
+/*
+ * The bitmap obstack is not thread safe.
+ * Therefore, every merging thread redirects the bitmaps it owns to a private obstack.
+ * They are redirected back to the default obstack when the merging is done.
+ * The private obstacks are never released, because the elements are still in use.
+ */
+static void
+redirect_bitmaps( bitmap* mat, int s, int e, bitmap_obstack* obs )
+{
+  for ( int i = s; i < e; ++i )
+    mat[i]->obstack = obs;
+}
+
+// Bucket tid holds the columns [lo, hi)
+static void
+scatter_bucket( int tid, void* arg )
+{
+  ScatterTask *task = (ScatterTask*)arg;
+  ParsedMatrix *pm = task->pm;
+  bitmap *store_T = task->store_T;
+  bitmap *load_T = task->load_T;
+  const int *row_ids = task->row_ids;
+  const int *row_types = pm->row_types;
+  bitmap_obstack *obs = &task->obstacks[tid];
+
+  int nb = pm->n_buckets;
+  int lo = ( (long)tid * pm->m + nb - 1 ) / nb;
+  int hi = ( (long)(tid+1) * pm->m + nb - 1 ) / nb;
+
+  bitmap_obstack_initialize( obs );
+  redirect_bitmaps( store_T, lo, hi, obs );
+  if ( load_T != store_T ) redirect_bitmaps( load_T, lo, hi, obs );
+
+  // Visiting the chunks in order keeps the rows ascending in every column
+  for ( int i = 0; i < pm->n_chunks; ++i ) {
+    RowChunk &chunk = pm->chunks[i];
+    VECTOR(int) &bkt = chunk.buckets[tid];
+    int size = bkt.size();
+
+    for ( int j = 0; j < size; j += 2 ) {
+      int r = chunk.first_row + bkt[j];
+      int c = bkt[j+1];
+      bitmap *mat_T = ( row_types != NULL && row_types[r] == SE_LOAD ? load_T : store_T );
+      bitmap_set_bit( mat_T[c], row_ids == NULL ? r : row_ids[r] );
+    }
+  }
+
+  redirect_bitmaps( store_T, lo, hi, &bitmap_default_obstack );
+  if ( load_T != store_T ) redirect_bitmaps( load_T, lo, hi, &bitmap_default_obstack );
+}
+
+// The bitmaps must be allocated from the default obstack
+void
+scatter_transposed( ParsedMatrix* pm, bitmap* store_T, bitmap* load_T, const int* row_ids )
+{
+  ScatterTask task;
+  task.pm = pm;
+  task.store_T = store_T;
+  task.load_T = load_T;
+  task.row_ids = row_ids;
+  task.obstacks = new bitmap_obstack[pm->n_buckets];
+
+  parallel_execute( pm->n_buckets, scatter_bucket, &task );
+  delete[] task.obstacks;
+}
+
+// Shared by the threads building the transposed CSR
+struct CsrTask
+{
+  ParsedMatrix *pm;
+  int load_shift;
+  CsrMatrix *mat_T;
+  long *pos;
+  // Hash consing only
+  row_fp_t *fps;
+  int *last_row;
+  int *c_reps;
+  bool *collided;
+};
+
+// Phase 1 : every thread counts the columns in its bucket
+static void
+count_bucket( int tid, void* arg )
+{
+  CsrTask *task = (CsrTask*)arg;
+  ParsedMatrix *pm = task->pm;
+  const int *row_types = pm->row_types;
+  long *pos = task->pos;
+
+  for ( int i = 0; i < pm->n_chunks; ++i ) {
+    RowChunk &chunk = pm->chunks[i];
+    VECTOR(int) &bkt = chunk.buckets[tid];
+    int size = bkt.size();
+
+    for ( int j = 0; j < size; j += 2 ) {
+      int r = chunk.first_row + bkt[j];
+      int c = bkt[j+1];
+      if ( row_types != NULL && row_types[r] == SE_LOAD ) c += task->load_shift;
+      pos[c]++;
+    }
+  }
+}
+
+// Phase 2 : every thread fills the columns in its bucket
+static void
+fill_bucket( int tid, void* arg )
+{
+  CsrTask *task = (CsrTask*)arg;
+  ParsedMatrix *pm = task->pm;
+  const int *row_types = pm->row_types;
+  int *elems = task->mat_T->elems;
+  long *pos = task->pos;
+
+  // Visiting the chunks in order keeps the rows ascending in every column
+  for ( int i = 0; i < pm->n_chunks; ++i ) {
+    RowChunk &chunk = pm->chunks[i];
+    VECTOR(int) &bkt = chunk.buckets[tid];
+    int size = bkt.size();
+
+    for ( int j = 0; j < size; j += 2 ) {
+      int r = chunk.first_row + bkt[j];
+      int c = bkt[j+1];
+      if ( row_types != NULL && row_types[r] == SE_LOAD ) c += task->load_shift;
+      elems[ pos[c]++ ] = r;
+    }
+  }
+}
+
+/*
+ * A bucket covers a column range, and both column c and c + load_shift of that range.
+ * Therefore, the threads never touch the same column.
+ */
+CsrMatrix*
+transpose_to_csr( ParsedMatrix* pm, int n_cols, int load_shift )
+{
+  CsrTask task;
+  CsrMatrix *mat_T = new CsrMatrix( n_cols, pm->n );
+  long *pos = new long[n_cols];
+  long *offs = mat_T->offs;
+
+  task.pm = pm;
+  task.load_shift = load_shift;
+  task.mat_T = mat_T;
+  task.pos = pos;
+
+  memset( pos, 0, sizeof(long) * n_cols );
+  parallel_execute( pm->n_buckets, count_bucket, &task );
+
+  for ( int i = 0; i < n_cols; ++i ) {
+    offs[i+1] = offs[i] + pos[i];
+    pos[i] = offs[i];
+  }
+
+  mat_T->elems = new int[ offs[n_cols] ];
+  parallel_execute( pm->n_buckets, fill_bucket, &task );
+  delete[] pos;
+
+  mat_T->remove_duplicates();
+  return mat_T;
+}
+
+// Phase 1 : fingerprint and count the columns in the bucket, the duplicated facts are skipped
+static void
+fingerprint_bucket( int tid, void* arg )
+{
+  CsrTask *task = (CsrTask*)arg;
+  ParsedMatrix *pm = task->pm;
+  long *pos = task->pos;
+  row_fp_t *fps = task->fps;
+  int *last_row = task->last_row;
+
+  for ( int i = 0; i < pm->n_chunks; ++i ) {
+    RowChunk &chunk = pm->chunks[i];
+    VECTOR(int) &bkt = chunk.buckets[tid];
+    int size = bkt.size();
+
+    for ( int j = 0; j < size; j += 2 ) {
+      int r = chunk.first_row + bkt[j];
+      int c = bkt[j+1];
+      if ( last_row[c] == r ) continue;
+      last_row[c] = r;
+      fps[c] = row_fp_add( fps[c], r );
+      pos[c]++;
+    }
+  }
+}
+
+// Phase 2 : fill the representative columns (fill = true), or verify the other columns
+static void
+fill_distinct_bucket( int tid, void* arg, bool fill )
+{
+  CsrTask *task = (CsrTask*)arg;
+  ParsedMatrix *pm = task->pm;
+  int *elems = task->mat_T->elems;
+  long *pos = task->pos;
+  int *last_row = task->last_row;
+  const int *c_reps = task->c_reps;
+
+  for ( int i = 0; i < pm->n_chunks; ++i ) {
+    RowChunk &chunk = pm->chunks[i];
+    VECTOR(int) &bkt = chunk.buckets[tid];
+    int size = bkt.size();
+
+    for ( int j = 0; j < size; j += 2 ) {
+      int r = chunk.first_row + bkt[j];
+      int c = bkt[j+1];
+      if ( last_row[c] == r ) continue;
+      last_row[c] = r;
+
+      if ( c_reps[c] == c ) {
+	if ( fill ) elems[ pos[c]++ ] = r;
+      }
+      else if ( !fill && elems[ pos[c]++ ] != r ) {
+	task->collided[tid] = true;
+	return;
+      }
+    }
+  }
+}
+
+static void
+fill_rep_bucket( int tid, void* arg )
+{
+  fill_distinct_bucket( tid, arg, true );
+}
+
+static void
+verify_dup_bucket( int tid, void* arg )
+{
+  fill_distinct_bucket( tid, arg, false );
+}
+
+// Two columns are candidates if they have the same fingerprint and length
+struct SameCount
+{
+  const long *counts;
+  bool operator()( int x, int y ) const { return counts[x] == counts[y]; }
+};
+
+CsrMatrix*
+transpose_distinct_to_csr( ParsedMatrix* pm, int n_cols, int* c_reps )
+{
+  int i;
+  CsrTask task;
+  int n_buckets = pm->n_buckets;
+
+  task.pm = pm;
+  task.load_shift = 0;
+  task.pos = new long[n_cols];
+  task.fps = new row_fp_t[n_cols];
+  task.last_row = new int[n_cols];
+  task.c_reps = c_reps;
+  task.collided = new bool[n_buckets];
+
+  memset( task.pos, 0, sizeof(long) * n_cols );
+  memset( task.last_row, -1, sizeof(int) * n_cols );
+  for ( i = 0; i < n_cols; ++i ) task.fps[i] = ROW_FP_SEED;
+  parallel_execute( n_buckets, fingerprint_bucket, &task );
+
+  // Pick the first column of every fingerprint as the candidate representative
+  RowHashTable ht( n_cols );
+  SameCount same;
+  same.counts = task.pos;
+  int n_reps = 0;
+
+  for ( i = 0; i < n_cols; ++i ) {
+    if ( task.pos[i] == 0 )
+      c_reps[i] = -1;
+    else {
+      c_reps[i] = ht.insert( row_fp_finish( task.fps[i] ), i, same );
+      if ( c_reps[i] == i ) ++n_reps;
+    }
+  }
+  delete[] task.fps;
+
+  // Only the representatives are materialized
+  CsrMatrix *mat_T = new CsrMatrix( n_reps, pm->n );
+  long *offs = mat_T->offs;
+  long *start = new long[n_cols];
+
+  n_reps = 0;
+  for ( i = 0; i < n_cols; ++i ) {
+    if ( c_reps[i] == i ) {
+      start[i] = offs[n_reps];
+      offs[n_reps+1] = offs[n_reps] + task.pos[i];
+      ++n_reps;
+    }
+  }
+
+  mat_T->elems = new int[ offs[n_reps] ];
+  task.mat_T = mat_T;
+
+  // Then the other columns are verified against their representatives
+  memcpy( task.pos, start, sizeof(long) * n_cols );
+  memset( task.last_row, -1, sizeof(int) * n_cols );
+  parallel_execute( n_buckets, fill_rep_bucket, &task );
+
+  for ( i = 0; i < n_cols; ++i ) {
+    int r = c_reps[i];
+    if ( r != -1 && r != i ) task.pos[i] = start[r];
+  }
+  memset( task.last_row, -1, sizeof(int) * n_cols );
+  memset( task.collided, 0, sizeof(bool) * n_buckets );
+  parallel_execute( n_buckets, verify_dup_bucket, &task );
+
+  bool collided = false;
+  for ( i = 0; i < n_buckets; ++i )
+    if ( task.collided[i] ) collided = true;
+
+  delete[] start;
+  delete[] task.pos;
+  delete[] task.last_row;
+  delete[] task.collided;
+
+  if ( collided ) {
+    // Two different columns share a fingerprint, we fall back to the full transpose
+    delete mat_T;
+    mat_T = transpose_to_csr( pm, n_cols, 0 );
+    compress_equivalent_rows( mat_T, c_reps );
+    return mat_T;
+  }
+
+  // Renumber the representatives by their first appearances
+  n_reps = 0;
+  for ( i = 0; i < n_cols; ++i ) {
+    if ( c_reps[i] == i )
+      c_reps[i] = n_reps++;
+    else if ( c_reps[i] != -1 )
+      c_reps[i] = c_reps[ c_reps[i] ];
+  }
+
+  return mat_T;
+}
+
+DiskCsrMatrix*
+transpose_to_disk( MatrixReader* reader, int n_cols, int load_shift, long budget,
+		   int* row_lens, int* n_loads )
+{
+  int n = reader->n;
+  int type = SE_STORE;
+  const int *cols;
+
+  DiskCsrMatrix *mat_T = new DiskCsrMatrix( n_cols, n, budget );
+  bool good = true;
+  if ( n_loads != NULL ) *n_loads = 0;
+
+  for ( int i = 0; i < n && good; ++i ) {
+    int k = reader->next_row( &type, &cols );
+    if ( k == -1 ) {
+      delete mat_T;
+      return NULL;
+    }
+
+    int shift = 0;
+    if ( reader->matrix_type == SE_MATRIX && type == SE_LOAD ) {
+      shift = load_shift;
+      if ( n_loads != NULL ) ++*n_loads;
+    }
+
+    row_lens[i] = k;
+    for ( int j = 0; j < k && good; ++j )
+      good = mat_T->add( cols[j] + shift, i );
+  }
+
+  if ( !good || !mat_T->freeze() ) {
+    fprintf( stderr, "Cannot write the transposed matrix to the temporary files.\n" );
+    delete mat_T;
+    return NULL;
+  }
+
+  return mat_T;
+}
+
+// Chunk tid holds the rows [first_row, first_row + n_rows)
+static void
+scatter_chunk( int tid, void* arg )
+{
+  ScatterTask *task = (ScatterTask*)arg;
+  ParsedMatrix *pm = task->pm;
+  RowChunk &chunk = pm->chunks[tid];
+  bitmap *mat = task->mat;
+  bitmap_obstack *obs = &task->obstacks[tid];
+
+  int s = chunk.first_row;
+  int e = s + chunk.n_rows;
+  int *cols = chunk.cols.begin();
+
+  bitmap_obstack_initialize( obs );
+  redirect_bitmaps( mat, s, e, obs );
+
+  for ( int i = s; i < e; ++i ) {
+    int k = pm->row_lens[i];
+    for ( int j = 0; j < k; ++j )
+      bitmap_set_bit( mat[i], cols[j] );
+    cols += k;
+  }
+
+  redirect_bitmaps( mat, s, e, &bitmap_default_obstack );
+}
+
+void
+scatter_rows( ParsedMatrix* pm, bitmap* mat )
+{
+  ScatterTask task;
+  task.pm = pm;
+  task.mat = mat;
+  task.obstacks = new bitmap_obstack[pm->n_chunks];
+
+  parallel_execute( pm->n_chunks, scatter_chunk, &task );
+  delete[] task.obstacks;
+}
+
+/*
+ * The columns are streamed out first, right behind the space reserved for the offsets and types.
+ * Then we seek back to fill the header, so that only O(n) memory is used.
+ */
+bool
+write_binary_matrix( MatrixReader* reader, FILE* fp )
+{
+  int n = reader->n;
+  int m = reader->m;
+  int reserved = 0;
+  bool is_se = ( reader->matrix_type == SE_MATRIX );
+
+  offset_t *offsets = new offset_t[n+1];
+  int *types = ( is_se ? new int[n] : NULL );
+
+  long header_size = BINARY_HEADER_SIZE + sizeof(offset_t) * (n+1);
+  if ( is_se ) header_size += sizeof(int) * n;
+  bool good = ( fseek( fp, header_size, SEEK_SET ) == 0 );
+
+  offsets[0] = 0;
+  for ( int i = 0; good && i < n; ++i ) {
+    const int *cols;
+    int type = SE_STORE;
+    int k = reader->next_row( &type, &cols );
+    if ( k == -1 ) {
+      good = false;
+      break;
+    }
+
+    if ( is_se ) types[i] = type;
+    offsets[i+1] = offsets[i] + k;
+    if ( fwrite( cols, sizeof(int), k, fp ) != (size_t)k ) good = false;
+  }
+
+  if ( good ) {
+    // Now we fill the header
+    fseek( fp, 0, SEEK_SET );
+    fwrite( is_se ? MATRIX_SE_1 : MATRIX_PT_1, sizeof(char), 4, fp );
+    fwrite( &n, sizeof(int), 1, fp );
+    fwrite( &m, sizeof(int), 1, fp );
+    fwrite( &reserved, sizeof(int), 1, fp );
+    fwrite( &offsets[n], sizeof(offset_t), 1, fp );
+    fwrite( offsets, sizeof(offset_t), n + 1, fp );
+    if ( is_se ) fwrite( types, sizeof(int), n, fp );
+    good = ( ferror( fp ) == 0 );
+  }
+
+  delete[] offsets;
+  if ( types != NULL ) delete[] types;
+
+  return good;
+}
@@ -0,0 +1,219 @@
+// Copyright 2014, Hong Kong University of Science and Technology. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * Readers for the input points-to/side-effect matrices.
+ * The indexers pull the matrix row by row through the MatrixReader interface,
+ * so they do not need to know how the rows are stored on disk.
+ *
+ * The edge list format (-F 3) gives the facts in arbitrary order after the header "n m":
+ * "row column" per line for points-to matrix, and "row flag column" per line for side-effect matrix.
+ *
+ * Besides the textual formats, we accept a binary compressed-sparse-row format:
+ *
+ * Magic Number (4 bytes, MATRIX_PT_1 or MATRIX_SE_1)
+ * n(rows) m(columns) 0(reserved)           3 x int32
+ * nnz(total number of columns)             int64
+ * row offsets (n+1)                        int64, row i owns columns [off[i], off[i+1])
+ * row types (n, side-effect matrix only)   int32, SE_STORE or SE_LOAD
+ * column indices (nnz)                     int32
+ */
+
+#ifndef MATRIX_IO_H
+#define MATRIX_IO_H
+
+#include <cstdio>
+#include "constants.hh"
+#include "options.hh"
+#include "bitmap.h"
+#include "csr-matrix.hh"
+
+// Rows decoded by one parsing thread
+struct RowChunk
+{
+  int first_row;            // global ID of the first row in this chunk
+  int n_rows;
+  VECTOR(int) lens;         // #columns of every row
+  VECTOR(int) types;        // store/load flags (side-effect matrix only)
+  VECTOR(int) cols;         // the columns row by row (if not bucketed)
+  VECTOR(int) *buckets;     // (local row, column) pairs grouped by column range (if bucketed)
+
+  RowChunk()
+  {
+    first_row = n_rows = 0;
+    buckets = NULL;
+  }
+
+  ~RowChunk()
+  {
+    if ( buckets != NULL ) delete[] buckets;
+  }
+};
+
+// The whole input matrix decoded by multiple threads
+class ParsedMatrix
+{
+public:
+  int n, m;
+  int *row_lens;            // #columns of every row
+  int *row_types;           // store/load flag of every row (side-effect matrix only)
+  int n_chunks;
+  RowChunk *chunks;         // chunks of consecutive rows, in row order
+  int n_buckets;            // #column ranges, 0 if not bucketed
+
+public:
+  ParsedMatrix( int row, int col, int n_chk, int n_bkt )
+  {
+    n = row; m = col;
+    n_chunks = n_chk;
+    n_buckets = n_bkt;
+    row_lens = new int[row];
+    row_types = NULL;
+    chunks = new RowChunk[n_chk];
+  }
+
+  ~ParsedMatrix()
+  {
+    delete[] row_lens;
+    if ( row_types != NULL ) delete[] row_types;
+    delete[] chunks;
+  }
+
+  // Column c falls in this range
+  int bucket_of( int c ) const
+  {
+    return (long)c * n_buckets / m;
+  }
+};
+
+class MatrixReader
+{
+public:
+  int n, m;               // #rows, #columns declared in the header
+  int matrix_type;        // PT_MATRIX or SE_MATRIX
+  int input_format;       // see constants.hh
+
+public:
+  virtual ~MatrixReader() {}
+
+  // Decode n and m, called once by open_matrix_reader
+  virtual bool read_header() = 0;
+
+  /*
+   * Decode the next row of the matrix.
+   * For side-effect matrix, type receives the store/load flag of the row.
+   * The columns are exposed through cols and stay valid until the next call.
+   * Returns the number of columns, or -1 if the input is broken.
+   */
+  virtual int next_row( int* type, const int** cols ) = 0;
+
+  /*
+   * Decode all the rows at once with n_threads threads.
+   * If bucketed, the columns are grouped by column ranges for a transposed merge.
+   * Returns NULL if the input cannot be split, the caller then falls back to next_row.
+   */
+  virtual ParsedMatrix* parse_in_parallel( int /*n_threads*/, bool /*bucketed*/ )
+  {
+    return NULL;
+  }
+};
+
+// The whole input matrix kept in memory, so that it can be read multiple times
+class MatrixSnapshot
+{
+public:
+  int n, m;
+  int matrix_type;
+  long *offs;               // row i is cols[offs[i], offs[i+1]), in the input order
+  int *cols;
+  int *types;               // store/load flags (side-effect matrix only)
+
+public:
+  MatrixSnapshot()
+  {
+    n = m = 0;
+    offs = NULL;
+    cols = NULL;
+    types = NULL;
+  }
+
+  ~MatrixSnapshot()
+  {
+    if ( offs != NULL ) delete[] offs;
+    if ( cols != NULL ) delete[] cols;
+    if ( types != NULL ) delete[] types;
+  }
+
+  // A new reader over the snapshot, which is independent of other readers
+  // The snapshot must outlive the reader
+  MatrixReader* open_reader() const;
+};
+
+// Read the rest rows of the matrix into memory
+// Returns NULL if the input is broken
+extern MatrixSnapshot*
+take_snapshot( MatrixReader* );
+
+/*
+ * Append the rest rows of delta to the rows of the snapshot, the result has the larger sizes of the two.
+ * The facts already in the snapshot are dropped, and touched_rows/touched_cols receive the flags of the rows/columns that gain new facts.
+ * Returns NULL if the delta is broken.
+ */
+extern MatrixSnapshot*
+append_facts( const MatrixSnapshot* snap, MatrixReader* delta, char** touched_rows, char** touched_cols );
+
+// Open the input matrix and read its header
+// Returns NULL if the file cannot be opened or the header is broken
+// The binary format is recognized by its magic number, input_format is then ignored
+// The file name "-" stands for the standard input, which can be a pipe
+// mem_budget is the number of bytes for sorting the edge list in memory
+extern MatrixReader*
+open_matrix_reader( const char* file_name, int matrix_type, int input_format,
+		    long mem_budget = DEFAULT_MEM_BUDGET );
+
+/*
+ * Set the bit row_ids[r] in store_T[c] (load_T[c] for load rows) for every fact (r, c).
+ * row_ids can be NULL, which means the identity mapping.
+ * The matrix must be decoded with bucketed = true, and every bucket is merged by one thread.
+ */
+extern void
+scatter_transposed( ParsedMatrix*, bitmap* store_T, bitmap* load_T, const int* row_ids );
+
+/*
+ * Build the transpose of the matrix with n_cols columns.
+ * The columns of the load rows are shifted by load_shift (side-effect matrix only).
+ * The matrix must be decoded with bucketed = true, and every bucket is merged by one thread.
+ */
+extern CsrMatrix*
+transpose_to_csr( ParsedMatrix*, int n_cols, int load_shift );
+
+/*
+ * The same as transpose_to_csr, but only the distinct non-empty columns are materialized (points-to matrix only).
+ * The equal columns are found by their fingerprints before filling the matrix.
+ * The result is the same as calling compress_equivalent_rows on the output of transpose_to_csr.
+ */
+extern CsrMatrix*
+transpose_distinct_to_csr( ParsedMatrix*, int n_cols, int* c_reps );
+
+/*
+ * Read the rest rows of the matrix into its transpose on the disk, the same n_cols and load_shift as above.
+ * The facts are sorted with budget bytes of memory.
+ * row_lens receives the #columns of every row, and n_loads the #load rows if it is not NULL.
+ * Returns NULL if the input is broken or the temporary files cannot be written.
+ */
+extern DiskCsrMatrix*
+transpose_to_disk( MatrixReader*, int n_cols, int load_shift, long budget,
+		   int* row_lens, int* n_loads );
+
+// Set the bit c in mat[r] for every fact (r, c), every chunk is merged by one thread
+// The matrix must be decoded with bucketed = false
+extern void
+scatter_rows( ParsedMatrix*, bitmap* mat );
+
+// Dump the rest of the matrix in the binary format
+// The output file must be seekable
+extern bool
+write_binary_matrix( MatrixReader*, std::FILE* );
+
+#endif
@@ -11,20 +11,46 @@
 #include <cstring>
 #include <cstdlib>
 #include "matrix-ops.hh"
+#include "row-hash.hh"
 
 using namespace std;
 
-#define N_PRIMES 6
-static int primes[] = { 7901, 21977, 89107, 358907, 2002841, 4088321 };
+// A 64-bit fingerprint of all the set bits
+static row_fp_t
+bitmap_fingerprint( bitmap head )
+{
+  row_fp_t h = ROW_FP_SEED;
+
+  for ( bitmap_element *ptr = head->first; ptr; ptr = ptr->next ) {
+    h = row_fp_add( h, ptr->indx );
+    for ( int ix = 0; ix != BITMAP_ELEMENT_WORDS; ix++ )
+      h = row_fp_add( h, ptr->bits[ix] );
+  }
 
-// hash table element
-// only used internally
-struct hash_node
+  return row_fp_finish( h );
+}
+
+// The bitmaps are only read, so they can be grouped by multiple threads
+class BitmapRowSet : public RowSet
 {
-  int idx;
-  struct hash_node *next;
-};
+public:
+  bitmap *mat;
 
+  bool empty( int i ) const
+  {
+    return bitmap_empty_p( mat[i] );
+  }
+
+  row_fp_t fingerprint( int i ) const
+  {
+    return bitmap_fingerprint( mat[i] );
+  }
+
+  bool same( int x, int y ) const
+  {
+    return bitmap_equal_p( mat[x], mat[y] );
+  }
+};
 
 static bool initialized = false;
 
@@ -41,12 +67,9 @@ __init_matrix_lib()
 }
 
 void
-compress_equivalent_rows( Cmatrix* A )
+compress_equivalent_rows( Cmatrix* A, int n_threads )
 {
   int i;
-  hashval_t hv;                 // type hashval_t is defined in bitmap.h
-  struct hash_node **HT;        // hash table
-  struct hash_node *p, *q;
 
   if ( A->r_reps != NULL ) return;
 
@@ -57,44 +80,14 @@ compress_equivalent_rows( Cmatrix* A )
 
   // create
   int *r_reps = new int[n];
- 
-  // Determine the suitable hash table size
-  for ( i = 0; i < N_PRIMES; ++i )
-    if ( primes[i] * 5 >= n ) break;
-  if ( i == N_PRIMES ) i--;
-  int hash_size = primes[i];
+  BitmapRowSet rows;
+  rows.mat = mat;
+  find_equal_rows( &rows, n, r_reps, n_threads );
   
-  HT = new hash_node*[hash_size];
-  memset( HT, 0, sizeof(void*) * hash_size );
-  
-  // Iterate over the rows
+  // Release the empty rows and the duplicates
   for ( i = 0; i < n; ++i ) {
-    if ( bitmap_empty_p( mat[i] ) ) {
-      // This is an empty row
-      r_reps[i] = -1;
-      BITMAP_FREE( mat[i] );
-      continue;
-    }
-    
-    hv = bitmap_hash( mat[i] ) % hash_size;
-    p = HT[hv];
-    while ( p ) {
-      if ( bitmap_equal_p( mat[i], mat[ p->idx ] ) ) break;
-      p = p -> next;
-    }
-    
-    if ( p != NULL ) {
-      // Found the representative for i
-      r_reps[i] = p -> idx;
+    if ( r_reps[i] != i )
       BITMAP_FREE( mat[i] );
-      continue;
-    }
-    
-    r_reps[i] = i;
-    p = new hash_node();
-    p -> idx = i;
-    p -> next = HT[hv];
-    HT[hv] = p;
   }
 
   // Now we cluster the rows
@@ -115,29 +108,17 @@ compress_equivalent_rows( Cmatrix* A )
     }
   }
 
-  // Next we delete the hash table
-  for ( i = 0; i < hash_size; ++i ) {
-    p = HT[i];
-    while ( p != NULL ) {
-      q = p->next;
-      delete p;
-      p = q;
-    }
-  }
-
   // assign back
   A -> mat = mat;
   A -> r_reps = r_reps;
   A -> n_r_reps = n_r_reps;
-
-  delete[] HT;
 }
 
 // First we compute the transpose
 // Then we compress the rows of the transpose
 // Finally, we cluster the column bits of the input matrix
 Cmatrix*
-compress_equivalent_columns( Cmatrix* A )
+compress_equivalent_columns( Cmatrix* A, int n_threads )
 {
   unsigned v;
   bitmap_iterator bi; 
@@ -146,7 +127,7 @@ compress_equivalent_columns( Cmatrix* A )
 
   // Create the column mapping from its transpose
   Cmatrix *A_T = transpose( A );
-  compress_equivalent_rows( A_T );
+  compress_equivalent_rows( A_T, n_threads );
 
   // copy
   int m = A->m;
@@ -94,14 +94,15 @@ extern bool
 __init_matrix_lib();
 
 // We compress the rows of the matrix
+// The equal rows are detected with n_threads threads, the result is the same for any n_threads
 extern void
-compress_equivalent_rows( Cmatrix* );
+compress_equivalent_rows( Cmatrix*, int n_threads = 1 );
 
 // We compress the columns of the matrix
 // Because we have to compute the transpose of the input matrix A first,
 // therefore, we return the transpose to the user for future use 
 extern Cmatrix*
-compress_equivalent_columns( Cmatrix* );
+compress_equivalent_columns( Cmatrix*, int n_threads = 1 );
 
 // Compute a transpose of the input matrix A
 extern Cmatrix*
@@ -0,0 +1,61 @@
+// Copyright 2014, Hong Kong University of Science and Technology. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * Implementation of the fork-join helper.
+ */
+
+#include <pthread.h>
+#include "parallel.hh"
+
+struct WorkerArgs
+{
+  int tid;
+  PARALLEL_WORKER worker;
+  void *arg;
+};
+
+static void*
+thread_entry( void* p )
+{
+  WorkerArgs *wa = (WorkerArgs*)p;
+  wa->worker( wa->tid, wa->arg );
+  return NULL;
+}
+
+void
+parallel_execute( int n_threads, PARALLEL_WORKER worker, void* arg )
+{
+  if ( n_threads <= 1 ) {
+    worker( 0, arg );
+    return;
+  }
+
+  pthread_t *threads = new pthread_t[n_threads];
+  WorkerArgs *args = new WorkerArgs[n_threads];
+  bool *started = new bool[n_threads];
+
+  for ( int i = 0; i < n_threads; ++i ) {
+    args[i].tid = i;
+    args[i].worker = worker;
+    args[i].arg = arg;
+  }
+
+  for ( int i = 1; i < n_threads; ++i )
+    started[i] = ( pthread_create( &threads[i], NULL, thread_entry, &args[i] ) == 0 );
+
+  worker( 0, arg );
+
+  for ( int i = 1; i < n_threads; ++i ) {
+    if ( started[i] )
+      pthread_join( threads[i], NULL );
+    else
+      // We run it by ourselves if the thread cannot be created
+      worker( i, arg );
+  }
+
+  delete[] threads;
+  delete[] args;
+  delete[] started;
+}
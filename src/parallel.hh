@@ -0,0 +1,21 @@
+// Copyright 2014, Hong Kong University of Science and Technology. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * A minimal fork-join helper on top of pthreads.
+ * The worker with tid 0 runs in the calling thread.
+ */
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+// Parm 1 : thread id, from 0 to n_threads-1
+// Parm 2 : the shared argument
+typedef void (*PARALLEL_WORKER)( int, void* );
+
+// Run the worker on n_threads threads and wait for all of them
+extern void
+parallel_execute( int n_threads, PARALLEL_WORKER, void* );
+
+#endif
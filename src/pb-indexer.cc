@@ -0,0 +1,283 @@
+// Copyright 2014, Hong Kong University of Science and Technology. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * A driver for constructing both the Pestrie index and the bitmap index.
+ * The input matrix is parsed once and shared by the two builders,
+ * which run concurrently in two threads.
+ */
+
+#include <cstdio>
+#include <unistd.h>
+#include <cstdlib>
+#include "constants.hh"
+#include "pestrie.hh"
+#include "bit-index.hh"
+#include "profile_helper.h"
+#include "matrix-io.hh"
+#include "parallel.hh"
+#include "engine-select.hh"
+
+using namespace std;
+
+static int matrix_type = PT_MATRIX;
+static char *input_file = NULL;
+static char *pes_file = NULL;
+static char *bit_file = NULL;
+static bool merging_eqls = true;
+static bool one_by_one = false;
+static bool auto_select = false;
+static const char* magic_numbers[] = { PESTRIE_PT_1, PESTRIE_SE_1 };
+
+// The jobs for the two builders
+struct BuildTask
+{
+  const MatrixSnapshot *snap;
+  const PesOpts *pes_opts;
+  bool good[2];
+};
+
+
+static void
+print_help( const char* prog_name )
+{
+  printf( "Pestrie version %s, Bitmap indexer version %s\n", PES_VERSION, BIT_VERSION );
+  printf( "Usage : %s [options] input_file pestrie_file bitmap_file\n", prog_name );
+  printf( "Options  : \n" );
+  printf( "-b [num] : Permutation of source nodes for Pestrie in the way of\n" );
+  printf( "       0 : Sort by size;\n" );
+  printf( "       1 : Sort by hub degrees (default);\n" );
+  printf( "       2 : Random;\n" );
+  printf( "       3 : Greedily pick the object that adds the fewest cross edges;\n" );
+  printf( "       4 : Predict the index of 0, 1 and 3 by a dry run, and use the smallest;\n" );
+  printf( "-e [num] : Specify the format of the input matrix\n" );
+  printf( "       0 : Points-to matrix (default);\n" );
+  printf( "       1 : Side-effect matrix.\n" );
+  printf( "-F       : Specify the format of the input file\n" );
+  printf( "       0 : Each line starts with the number of the following elements (default);\n" );
+  printf( "       1 : Each line ends with -1;\n" );
+  printf( "       3 : Unsorted edge list, one (pointer, object) pair per line.\n" );
+  printf( "-M [num] : Sort the edge list with num MB memory, then spill to the disk (default = %d).\n", DEFAULT_MEM_BUDGET_MB );
+  printf( "-o [file]: Save the order of the objects for Pestrie to the file.\n" );
+  printf( "-r [file]: Start Pestrie from the order saved by -o, only the new objects are weighed and slotted in.\n" );
+  printf( "-m       : Disable indistinguishable objects merging for Pestrie.\n" );
+  printf( "-j       : Do not merge the equivalent pointers/objects for bitmap index.\n" );
+  printf( "-s       : Build the two indexes one after another, the statistics are then not interleaved.\n" );
+  printf( "-a       : Predict which index is better for the input and only build that one.\n" );
+  printf( "-t [num] : Use num worker threads for parsing, merging the objects and building the components of Pestrie (default = 1).\n" );
+  printf( "The input_file can be - for reading the matrix from the standard input.\n" );
+}
+
+static PesOpts*
+parse_options( int argc, char **argv )
+{
+  int c;
+
+  PesOpts* pes_opts = new PesOpts();
+
+  while ( (c = getopt( argc, argv, "b:e:F:M:o:r:mjsat:h" ) ) != -1 ) {
+    switch ( c ) {
+    case 'b':
+      pes_opts->permute_way = atoi( optarg );
+      break;
+
+    case 'e':
+      matrix_type = atoi( optarg );
+      break;
+
+    case 'F':
+      pes_opts->input_format = atoi( optarg );
+      break;
+
+    case 'M':
+      pes_opts->mem_budget = atol( optarg ) << 20;
+      break;
+
+    case 'o':
+      pes_opts->order_out = optarg;
+      break;
+
+    case 'r':
+      pes_opts->order_in = optarg;
+      break;
+
+    case 'm':
+      pes_opts->obj_merge = false;
+      break;
+
+    case 'j':
+      merging_eqls = false;
+      break;
+
+    case 's':
+      one_by_one = true;
+      break;
+
+    case 'a':
+      auto_select = true;
+      break;
+
+    case 't':
+      pes_opts->n_threads = atoi( optarg );
+      if ( pes_opts->n_threads < 1 ) pes_opts->n_threads = 1;
+      break;
+
+    case 'h':
+      print_help( argv[0] );
+      delete pes_opts;
+      return NULL;
+
+    default:
+      printf( "This program doesn't support this argument.\n" );
+      break;
+    }
+  }
+
+  if ( optind + 3 > argc ) {
+    print_help( argv[0] );
+    delete pes_opts;
+    return NULL;
+  }
+
+  if ( matrix_type != PT_MATRIX &&
+       matrix_type != SE_MATRIX ) {
+    printf( "Wrong input matrix type. \n" );
+    delete pes_opts;
+    return NULL;
+  }
+
+  input_file = argv[optind++];
+  pes_file = argv[optind++];
+  bit_file = argv[optind];
+  return pes_opts;
+}
+
+static FILE*
+open_output( const char* file_name )
+{
+  FILE *fp = fopen( file_name, "wb" );
+  if ( fp == NULL )
+    fprintf( stderr, "Cannot write to the file: %s\n", file_name );
+  return fp;
+}
+
+static bool
+build_pestrie( const MatrixSnapshot* snap, const PesOpts* pes_opts )
+{
+  MatrixReader *reader = snap->open_reader();
+  PesTrie *pestrie = NULL;
+
+  if ( matrix_type == PT_MATRIX )
+    pestrie = self_parse_input( reader, pes_opts );
+  else
+    pestrie = dual_parse_input( reader, pes_opts );
+
+  delete reader;
+  if ( pestrie == NULL ) return false;
+
+  build_index_with_pestrie( pestrie );
+
+  FILE *fp = open_output( pes_file );
+  if ( fp != NULL ) {
+    pestrie->externalize_index( fp, magic_numbers[matrix_type] );
+    fclose( fp );
+  }
+
+  delete pestrie;
+  return fp != NULL;
+}
+
+static bool
+build_bitmap( const MatrixSnapshot* snap, int n_threads )
+{
+  MatrixReader *reader = snap->open_reader();
+  BitIndexer *indexer = NULL;
+
+  if ( matrix_type == PT_MATRIX )
+    indexer = parse_points_to_input( reader, n_threads );
+  else
+    indexer = parse_side_effect_input( reader, n_threads );
+
+  delete reader;
+  if ( indexer == NULL ) return false;
+
+  indexer->fp_generate_index( indexer, merging_eqls );
+
+  FILE *fp = open_output( bit_file );
+  if ( fp != NULL ) {
+    indexer->fp_externalize_index( indexer, fp, false );
+    fclose( fp );
+  }
+
+  delete indexer;
+  return fp != NULL;
+}
+
+// Worker 0 builds Pestrie, worker 1 builds the bitmap index
+static void
+build_worker( int tid, void* arg )
+{
+  BuildTask *task = (BuildTask*)arg;
+
+  if ( tid == 0 )
+    task->good[0] = build_pestrie( task->snap, task->pes_opts );
+  else
+    task->good[1] = build_bitmap( task->snap, task->pes_opts->n_threads );
+}
+
+int
+main( int argc, char** argv )
+{
+  PesOpts* pes_opts = NULL;
+
+  if ( (pes_opts = parse_options( argc, argv )) == NULL )
+    return -1;
+
+  // The global states of both libraries are set up before spawning the builders
+  init_pestrie();
+  __init_matrix_lib();
+
+  MatrixReader *reader = open_matrix_reader( input_file, matrix_type,
+					     pes_opts->input_format, pes_opts->mem_budget );
+  if ( reader == NULL ) {
+    fprintf( stderr, "Loading file failed.\n" );
+    delete pes_opts;
+    return -1;
+  }
+
+  fprintf( stderr, "\n---------Input: %s---------\n", input_file );
+  MatrixSnapshot *snap = take_snapshot( reader );
+  delete reader;
+  if ( snap == NULL ) {
+    delete pes_opts;
+    return -1;
+  }
+  show_res_use( "Input" );
+
+  BuildTask task;
+  task.snap = snap;
+  task.pes_opts = pes_opts;
+  task.good[0] = task.good[1] = false;
+
+  if ( auto_select ) {
+    // The statistics and the reasons of the choice are recorded in the log
+    EngineEstimate *est = select_engine( snap );
+    est->print( stderr );
+    int engine = est->engine;
+    delete est;
+
+    task.good[1-engine] = true;
+    build_worker( engine, &task );
+  }
+  else if ( one_by_one ) {
+    build_worker( 0, &task );
+    build_worker( 1, &task );
+  }
+  else
+    parallel_execute( 2, build_worker, &task );
+
+  delete snap;
+  delete pes_opts;
+  return ( task.good[0] && task.good[1] ) ? 0 : -1;
+}
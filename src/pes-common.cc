@@ -10,53 +10,66 @@
  */
 
 #include <vector>
+#include <algorithm>
 #include <cmath>
 #include <ctime>
 #include <cstring>
+#include <cstdlib>
+#include <unistd.h>
 #include "segtree.hh"
+#include "ext-sort.hh"
 #include "histogram.hh"
 #include "pestrie.hh"
 #include "profile_helper.h"
 #include "matrix-ops.hh"
+#include "row-hash.hh"
+#include "parallel.hh"
 
 using namespace std;
 
 /*
  * Two objects are equivalent if they are always pointed to by the same pointers.
  * We merge them in order to build less PesTrie subtrees.
+ * For the side-effect matrix, the store and load shadows of two objects must be both equivalent,
+ * and the merged shadows are still split into two halves of mat_T.
  */
 void 
 PesTrie::merge_equivalent_rows()
 {
   // obtain
-  int n = this->n;
   int m = this->m;
-  bitmap* mat_T = this->mat_T;
-  MatrixRow *r_order = this->r_order;
+  CsrMatrix* mat_T = this->mat_T;
+  DiskCsrMatrix* disk_T = this->disk_T;
+  int n_threads = this->pes_opts->n_threads;
 
   // create
   int *m_rep = NULL;
   int n_reps = m;
 
-  if ( this->pes_opts->obj_merge == true &&
-       this->index_type != SE_MATRIX ) {
+  // The objects may have been merged by the parser
+  if ( this->m_rep != NULL ) return;
 
+  if ( this->pes_opts->obj_merge == true ) {
     // m_rep is a mapping from raw_id to aggregated_id.
     // appendix: raw_id --(many-to-1)-> aggregated_id --(1-to-1)-> sorted_id
-    
-    // We use the matrix library to identify the representatives
-    Cmatrix *cmat = new Cmatrix( m, n, false );
-    cmat->mat = mat_T;
-    compress_equivalent_rows( cmat );
-
-    // copy back
-    m_rep = cmat->r_reps;
-    n_reps = cmat->n_r_reps;
-    
-    // delete
-    cmat->mat = NULL;
-    cmat->r_reps = NULL;
-    delete cmat;       
+    // The representatives are moved to the front of mat_T
+    m_rep = new int[m];
+    if ( disk_T != NULL ) {
+      // The representatives are copied to a new file in the low-memory mode
+      if ( this->index_type == SE_MATRIX )
+	n_reps = compress_equivalent_row_pairs( disk_T, m_rep, n_threads );
+      else
+	n_reps = compress_equivalent_rows( disk_T, m_rep, n_threads );
+      if ( n_reps == -1 ) {
+	fprintf( stderr, "Cannot write the transposed matrix to the temporary files.\n" );
+	exit( -1 );
+      }
+      if ( this->index_type == SE_MATRIX ) n_reps *= 2;
+    }
+    else if ( this->index_type == SE_MATRIX )
+      n_reps = 2 * compress_equivalent_row_pairs( mat_T, m_rep, n_threads );
+    else
+      n_reps = compress_equivalent_rows( mat_T, m_rep, n_threads );
   }
   
   // modify
@@ -64,54 +77,1273 @@ PesTrie::merge_equivalent_rows()
   this->m_rep = m_rep;
 }
 
+// The pointers are summarized by the objects they point to, which are the rows of mat_T they appear in
+struct PointerSet : public RowSet
+{
+  row_fp_t *fps;
+  int *cnt;
+
+  bool empty( int i ) const { return cnt[i] == 0; }
+  row_fp_t fingerprint( int i ) const { return fps[i]; }
+  // Equal fingerprints and sizes are only a hint, they are verified by a scan afterwards
+  bool same( int x, int y ) const { return cnt[x] == cnt[y]; }
+};
 
 /*
- * A 3-pass scan algorithm to build the PesTrie.
- * 2-pass is also possible, but it requires one more linear space vector.
+ * Two pointers are equivalent if they point to the same objects.
+ * They always fall into the same ES, thus we build PesTrie over the representatives only,
+ * and the pointers are mapped to the ES of their representatives in the end.
+ * The representatives keep the relative order of the pointers, hence the PesTrie shape is unchanged.
  */
-void 
-PesTrie::build_pestrie_core()
+void
+PesTrie::merge_equivalent_pointers()
 {
-  int i, j, k;
-  int es, last_vertex_num, Q_end;
-  unsigned x, y;
-  bitmap_iterator bi;
-  
-  // Obtain existing data
   int n = this->n;
   int cm = this->cm;
-  bitmap* mat_T = this->mat_T;
+  CsrMatrix* mat_T = this->mat_T;
+  int *r_count = this->r_count;
+
+  PointerSet ps;
+  ps.fps = new row_fp_t[n];
+  ps.cnt = new int[n];
+  for ( int i = 0; i < n; ++i ) {
+    ps.fps[i] = ROW_FP_SEED;
+    ps.cnt[i] = 0;
+  }
+
+  for ( int k = 0; k < cm; ++k ) {
+    for ( const int *p = mat_T->row_begin(k), *e = mat_T->row_end(k); p < e; ++p ) {
+      int x = *p;
+      ps.fps[x] = row_fp_add( ps.fps[x], k );
+      ps.cnt[x]++;
+    }
+  }
+
+  for ( int i = 0; i < n; ++i )
+    if ( ps.cnt[i] != 0 ) ps.fps[i] = row_fp_finish( ps.fps[i] );
+
+  int *p_rep = new int[n];
+  find_equal_rows( &ps, n, p_rep, this->pes_opts->n_threads );
+  delete[] ps.fps;
+
+  // A pointer has the same objects as its representative if they have the same size,
+  // and its representative appears in every row it appears in.
+  // Otherwise the fingerprints collide, and the pointer becomes a representative by itself.
+  int *stamp = ps.cnt;
+  memset( stamp, -1, sizeof(int) * n );
+  for ( int k = 0; k < cm; ++k ) {
+    const int *s = mat_T->row_begin(k), *e = mat_T->row_end(k);
+    for ( const int *p = s; p < e; ++p )
+      if ( p_rep[*p] == *p ) stamp[*p] = k;
+
+    for ( const int *p = s; p < e; ++p ) {
+      int x = *p;
+      if ( stamp[p_rep[x]] != k ) p_rep[x] = x;
+    }
+  }
+
+  // Renumber the representatives by their IDs
+  int *c_id = stamp;
+  int cn = 0;
+  for ( int i = 0; i < n; ++i ) {
+    if ( p_rep[i] == i ) {
+      c_id[i] = cn;
+      r_count[cn] = r_count[i];
+      ++cn;
+    }
+  }
+
+  // Only the representatives are kept in mat_T
+  long k = 0;
+  for ( int i = 0; i < cm; ++i ) {
+    long s = mat_T->offs[i], e = mat_T->offs[i+1];
+    mat_T->offs[i] = k;
+    for ( long j = s; j < e; ++j ) {
+      int x = mat_T->elems[j];
+      if ( p_rep[x] == x ) mat_T->elems[k++] = c_id[x];
+    }
+  }
+  mat_T->offs[cm] = k;
+  mat_T->m = cn;
+
+  for ( int i = 0; i < n; ++i )
+    if ( p_rep[i] != -1 ) p_rep[i] = c_id[p_rep[i]];
+
+  delete[] ps.cnt;
+
+  fprintf( stderr, "Pointers : %d are collapsed into %d representatives.\n", n, cn );
+
+  this->cn = cn;
+  this->p_rep = p_rep;
+}
+
+
+struct WeighingTask
+{
+  const CsrMatrix *mat_T;
+  const DiskCsrMatrix *disk_T;
+  const int *r_count;
+  MatrixRow *rows;
+  int n_rows, shift;
+  int permute_way;
+  int n_threads;
+};
+
+// buf receives the row if it is read from the disk
+static long
+row_weight( const WeighingTask* task, int i, int* buf )
+{
+  // The greedy order breaks the ties by the hub degrees
+  if ( task->permute_way == SORT_BY_HUB_DEGREE ||
+       task->permute_way == SORT_BY_CROSS_EDGES ) {
+    if ( task->disk_T != NULL )
+      return hub_degree( task->disk_T, i, task->r_count, buf );
+    return hub_degree( task->mat_T, i, task->r_count );
+  }
+
+  if ( task->permute_way == SORT_BY_SIZE ) {
+    // number of elements for each row in the input matrix
+    if ( task->disk_T != NULL )
+      return task->disk_T->row_size(i);
+    return task->mat_T->row_size(i);
+  }
+
+  return 0;
+}
+
+static void
+weigh_worker( int tid, void* arg )
+{
+  WeighingTask *task = (WeighingTask*)arg;
+  int lo = (long)task->n_rows * tid / task->n_threads;
+  int hi = (long)task->n_rows * ( tid + 1 ) / task->n_threads;
+  int *buf = ( task->disk_T == NULL ? NULL : new int[ task->disk_T->m ] );
+
+  for ( int i = lo; i < hi; ++i ) {
+    int id = task->rows[i].id;
+    long wt = row_weight( task, id, buf );
+    if ( task->shift > 0 )
+      wt += row_weight( task, id + task->shift, buf );
+    task->rows[i].wt = wt;
+  }
+
+  if ( buf != NULL ) delete[] buf;
+}
+
+/*
+ * A stable LSD radix sort of the rows from the largest weight to the smallest.
+ * The weights are mapped to unsigned keys in the reversed order,
+ * and the bytes that are equal for all the rows are skipped.
+ */
+static void
+radix_sort_rows( MatrixRow* rows, int n )
+{
+  if ( n <= 1 ) return;
+
+  const int n_digits = sizeof(long);
+  unsigned long flip = ~( 1UL << ( n_digits * 8 - 1 ) );
+
+  // Count the bytes at all the positions in one pass
+  long (*counts)[256] = new long[n_digits][256];
+  memset( counts, 0, sizeof(long) * n_digits * 256 );
+  for ( int i = 0; i < n; ++i ) {
+    unsigned long key = (unsigned long)rows[i].wt ^ flip;
+    for ( int d = 0; d < n_digits; ++d )
+      counts[d][( key >> ( d * 8 ) ) & 255]++;
+  }
+
+  MatrixRow *src = rows;
+  MatrixRow *dst = new MatrixRow[n];
+  long pos[256];
+
+  for ( int d = 0; d < n_digits; ++d ) {
+    long *cnt = counts[d];
+    int shift = d * 8;
+
+    // Every row has the same byte here
+    unsigned long b0 = ( ( (unsigned long)src[0].wt ^ flip ) >> shift ) & 255;
+    if ( cnt[b0] == n ) continue;
+
+    long s = 0;
+    for ( int b = 0; b < 256; ++b ) {
+      pos[b] = s;
+      s += cnt[b];
+    }
+
+    for ( int i = 0; i < n; ++i ) {
+      unsigned long key = (unsigned long)src[i].wt ^ flip;
+      dst[ pos[( key >> shift ) & 255]++ ] = src[i];
+    }
+
+    MatrixRow *t = src; src = dst; dst = t;
+  }
+
+  if ( src != rows ) {
+    memcpy( rows, src, sizeof(MatrixRow) * n );
+    dst = src;
+  }
+
+  delete[] dst;
+  delete[] counts;
+}
+
+// The weights are computed in parallel, since every row is weighed independently
+void
+PesTrie::weigh_rows( MatrixRow* rows, int n_rows, int shift, int permute_way )
+{
+  if ( n_rows == 0 ) return;
+
+  WeighingTask task;
+  task.mat_T = this->mat_T;
+  task.disk_T = this->disk_T;
+  task.r_count = this->r_count;
+  task.rows = rows;
+  task.n_rows = n_rows;
+  task.shift = shift;
+  task.permute_way = permute_way;
+
+  // Thin slices are not worth a thread
+  task.n_threads = this->pes_opts->n_threads;
+  if ( task.n_threads > n_rows / 1024 ) task.n_threads = n_rows / 1024;
+  if ( task.n_threads < 1 ) task.n_threads = 1;
+
+  parallel_execute( task.n_threads, weigh_worker, &task );
+}
+
+// The result is the same as stable_sort by MatrixRow::operator<
+void
+PesTrie::weigh_and_sort_rows( MatrixRow* rows, int n_rows, int shift, int permute_way )
+{
+  weigh_rows( rows, n_rows, shift, permute_way );
+  radix_sort_rows( rows, n_rows );
+}
+
+/*
+ * Tracks the ES partition of the pointers while the trees are added, without building PesTrie.
+ * It follows build_pestrie_core: the ES of a tree's pointers is split if it is partially covered,
+ * and every ES reached by the new tree costs a cross edge.
+ * A non-root ES always holds a pointer and a root holds its object, so there are at most n + n_trees ESes.
+ */
+class EsPartition
+{
+public:
+  EsPartition( int n, int n_trees )
+  {
+    es_num = 0;
+    n_splits = 0;
+    step = 0;
+    logging = false;
+    int n_es = n + n_trees;
+    bl = new int[n];
+    es_size = new int[n_es];
+    covered = new int[n_es];
+    split = new int[n_es];
+    stamp = new int[n_es];
+    pes = new int[n_es];
+    tr_stamp = new int[n_trees];
+    tr_size = new int[n_trees];
+    memset( bl, -1, sizeof(int) * n );
+    memset( stamp, -1, sizeof(int) * n_es );
+    memset( tr_stamp, -1, sizeof(int) * n_trees );
+  }
+
+  ~EsPartition()
+  {
+    delete[] bl;
+    delete[] es_size;
+    delete[] covered;
+    delete[] split;
+    delete[] stamp;
+    delete[] pes;
+    delete[] tr_stamp;
+    delete[] tr_size;
+  }
+
+  // #figures if the row r of mat_T were added as a tree: one per cross edge and one per pair into different trees
+  double count_figures( const CsrMatrix* mat_T, int r )
+  {
+    double pairs;
+    long x = touch_es( mat_T, r, &pairs );
+    return x + pairs;
+  }
+
+  // The trees added after mark() are taken back by rollback()
+  void mark()
+  {
+    logging = true;
+    mark_es_num = es_num;
+    mark_splits = n_splits;
+    j_addr.clear();
+    j_old.clear();
+  }
+
+  void rollback()
+  {
+    for ( int i = j_addr.size() - 1; i >= 0; --i )
+      *j_addr[i] = j_old[i];
+    es_num = mark_es_num;
+    n_splits = mark_splits;
+    logging = false;
+  }
+
+  /*
+   * Add the row r of mat_T as the tree tr, and return its #cross edges.
+   * pairs receives the #pairs of its cross edges that go into different trees,
+   * they are paired up by build_index.
+   */
+  long add_tree( const CsrMatrix* mat_T, int r, int tr, double* pairs )
+  {
+    const int *p, *e;
+    int root = -1;
+    long x = touch_es( mat_T, r, pairs );
+
+    // Then, move the pointers to the new ES
+    for ( p = mat_T->row_begin(r), e = mat_T->row_end(r); p < e; ++p ) {
+      int y = *p;
+      int es = bl[y];
+      if ( es == -1 ) {
+	if ( root == -1 ) {
+	  // The root also holds the object, so it is never fully covered
+	  root = es_num++;
+	  es_size[root] = 1;
+	  pes[root] = tr;
+	}
+	save( bl + y );
+	bl[y] = root;
+	es_size[root]++;
+	continue;
+      }
+
+      if ( split[es] == -1 ) {
+	if ( covered[es] < es_size[es] ) {
+	  // Partially covered, a new ES is split out
+	  int s = es_num++;
+	  es_size[s] = covered[es];
+	  save( es_size + es );
+	  es_size[es] -= covered[es];
+	  pes[s] = pes[es];
+	  split[es] = s;
+	  ++n_splits;
+	}
+	else
+	  split[es] = es;
+      }
+      save( bl + y );
+      bl[y] = split[es];
+    }
+
+    return x;
+  }
+
+public:
+  int n_splits;              // #ESes split out, they are the non-root PesTrie nodes
+
+private:
+  void save( int* addr )
+  {
+    if ( !logging ) return;
+    j_addr.push_back( addr );
+    j_old.push_back( *addr );
+  }
+
+  // Count how many pointers of every ES reached by the row r are covered, and return the #ESes reached
+  long touch_es( const CsrMatrix* mat_T, int r, double* pairs )
+  {
+    long x = 0;
+    double sq = 0;
+
+    ++step;
+    for ( const int *p = mat_T->row_begin(r), *e = mat_T->row_end(r); p < e; ++p ) {
+      int es = bl[*p];
+      if ( es == -1 ) continue;
+      if ( stamp[es] != step ) {
+	stamp[es] = step;
+	covered[es] = 0;
+	split[es] = -1;
+	++x;
+
+	int t = pes[es];
+	if ( tr_stamp[t] != step ) {
+	  tr_stamp[t] = step;
+	  tr_size[t] = 0;
+	}
+	sq += 2 * tr_size[t] + 1;
+	tr_size[t]++;
+      }
+      covered[es]++;
+    }
+
+    // sq is the sum of the squared group sizes
+    *pairs = ( (double)x * x - sq ) / 2;
+    return x;
+  }
+
+private:
+  int es_num, step;
+  int *bl, *es_size;
+  int *covered, *split, *stamp;
+  int *pes;                  // the tree of every ES
+  int *tr_stamp, *tr_size;   // the #cross edges into every tree, for the scanned rows
+  bool logging;              // the old values are journaled for rollback
+  int mark_es_num, mark_splits;
+  VECTOR(int*) j_addr;
+  VECTOR(int) j_old;
+};
+
+/*
+ * Replay the trees in the order to predict the PesTrie and its index, row i + shift follows row i if shift > 0.
+ * The figures are counted as build_index does:
+ * 1. PesTrieSelf: one for every cross edge, and one for every two cross edges into different trees;
+ * 2. PesTrieDual: the (cross edges + 1) of a store tree times the (cross edges + 1) of its load tree,
+ *    plus the store-store figures as in 1.
+ */
+static void
+simulate_trees( const CsrMatrix* mat_T, const MatrixRow* order, int n_rows, int shift, DryRun* res )
+{
+  int n_trees = ( shift > 0 ? n_rows * 2 : n_rows );
+  EsPartition part( mat_T->m, n_trees );
+  long *store_cross = NULL;
+
+  res->n_cross = 0;
+  res->n_figures = 0;
+  res->max_figures = 0;
+  res->max_tree = -1;
+  if ( shift > 0 ) store_cross = new long[n_rows];
+
+  for ( int i = 0; i < n_trees; ++i ) {
+    int r = ( i < n_rows ? order[i].id : order[i-n_rows].id + shift );
+    double pairs;
+    long x = part.add_tree( mat_T, r, i, &pairs );
+    double figures;
+
+    res->n_cross += x;
+    if ( shift == 0 )
+      figures = x + pairs;
+    else if ( i < n_rows ) {
+      // The store-load figures wait for the load tree
+      store_cross[i] = x;
+      figures = x + pairs;
+    }
+    else
+      figures = (double)( store_cross[i-n_rows] + 1 ) * ( x + 1 );
+
+    res->n_figures += figures;
+    if ( figures > res->max_figures ) {
+      res->max_figures = figures;
+      res->max_tree = r;
+    }
+  }
+
+  res->vn = n_trees + part.n_splits;
+  if ( store_cross != NULL ) delete[] store_cross;
+}
+
+// The greedy order picks from this many objects in the hub degree order
+#define GREEDY_WINDOW 4
+
+/*
+ * Every time we pick the object whose tree adds the fewest figures to the trees built so far,
+ * i.e. its new cross edges and the pairs of them that go into different trees.
+ * Picking from all the objects defers the hubs, and the late hubs split the ESes into many small pieces.
+ * Therefore, we only pick from the next GREEDY_WINDOW objects in the hub degree order,
+ * and the ties are broken by the hub degrees.
+ * For a side-effect matrix, build_pestrie_core builds all the store trees before the load trees,
+ * thus only the store trees can be replayed while picking, and the loads follow the same order.
+ * The picks are local, so both orders are simulated at the end and the greedy one is kept only if it generates fewer figures.
+ * res receives the simulation of the order taken if it is not NULL.
+ */
+void
+PesTrie::order_by_cross_edges( MatrixRow* r_order, int n_rows, int shift, DryRun* res )
+{
+  CsrMatrix *mat_T = this->mat_T;
+
+  weigh_and_sort_rows( r_order, n_rows, shift, SORT_BY_CROSS_EDGES );
+  MatrixRow *greedy = new MatrixRow[n_rows];
+  EsPartition part( mat_T->m, n_rows );
+  double pairs;
+
+  // The window keeps the candidates by their hub degree ranks
+  int window[GREEDY_WINDOW];
+  int w_size = 0, next = 0;
+
+  for ( int i = 0; i < n_rows; ++i ) {
+    while ( w_size < GREEDY_WINDOW && next < n_rows )
+      window[w_size++] = next++;
+
+    // Another candidate goes before the hub only if the two trees generate fewer figures in that order
+    int h = r_order[window[0]].id;
+    double f_h = part.count_figures( mat_T, h );
+    int best = 0;
+    double best_gain = 0;
+    for ( int j = 1; j < w_size; ++j ) {
+      int c = r_order[window[j]].id;
+      double f_c = part.count_figures( mat_T, c );
+
+      part.mark();
+      part.add_tree( mat_T, h, i, &pairs );
+      double hub_first = f_h + part.count_figures( mat_T, c );
+      part.rollback();
+
+      part.mark();
+      part.add_tree( mat_T, c, i, &pairs );
+      double gain = hub_first - f_c - part.count_figures( mat_T, h );
+      part.rollback();
+
+      if ( gain > best_gain ) {
+	best = j;
+	best_gain = gain;
+      }
+    }
+
+    greedy[i] = r_order[window[best]];
+    for ( int j = best + 1; j < w_size; ++j ) window[j-1] = window[j];
+    --w_size;
+    part.add_tree( mat_T, greedy[i].id, i, &pairs );
+  }
+
+  DryRun hub, own;
+  simulate_trees( mat_T, r_order, n_rows, shift, &hub );
+  simulate_trees( mat_T, greedy, n_rows, shift, &own );
+  bool keep = own.n_figures < hub.n_figures;
+
+  if ( this->pes_opts->profile_in_detail )
+    fprintf( stderr, "Greedy order : cross edges = %ld, figures = %.0lf; hub degree order : cross edges = %ld, figures = %.0lf. Use the %s order.\n",
+	     own.n_cross, own.n_figures, hub.n_cross, hub.n_figures, keep ? "greedy" : "hub degree" );
+
+  if ( keep ) memcpy( r_order, greedy, sizeof(MatrixRow) * n_rows );
+  if ( res != NULL ) *res = ( keep ? own : hub );
+  delete[] greedy;
+}
+
+static void
+print_dry_run( const char* name, const DryRun* res )
+{
+  fprintf( stderr, "%-12s: ES = %d, cross edges = %ld, figures = %.0lf, the largest tree generates %.0lf\n",
+	   name, res->vn, res->n_cross, res->n_figures, res->max_figures );
+}
+
+/*
+ * We try the deterministic orders by replaying the trees, and keep the one that generates the fewest figures.
+ * The replay costs a scan of mat_T per order, which is far cheaper than pairing up the cross edges.
+ */
+void
+PesTrie::dry_run_orders( int n_rows, int shift )
+{
+  const int ways[] = { SORT_BY_HUB_DEGREE, SORT_BY_SIZE, SORT_BY_CROSS_EDGES };
+  const char* names[] = { "Hub degree", "Size", "Greedy" };
+  int n_ways = sizeof(ways) / sizeof(int);
+
+  MatrixRow *cand = new MatrixRow[n_rows];
+  MatrixRow *best = new MatrixRow[n_rows];
+  DryRun res, best_res;
+  int best_way = -1;
+
+  fprintf( stderr, "\n------------Dry Run of the Orders--------------\n" );
+
+  for ( int w = 0; w < n_ways; ++w ) {
+    for ( int i = 0; i < n_rows; ++i ) {
+      cand[i].id = i;
+      cand[i].wt = 0;
+    }
+
+    // The greedy order is simulated while it is built
+    if ( ways[w] == SORT_BY_CROSS_EDGES )
+      order_by_cross_edges( cand, n_rows, shift, &res );
+    else {
+      weigh_and_sort_rows( cand, n_rows, shift, ways[w] );
+      simulate_trees( this->mat_T, cand, n_rows, shift, &res );
+    }
+    print_dry_run( names[w], &res );
+
+    if ( best_way == -1 ||
+	 res.n_figures < best_res.n_figures ||
+	 ( res.n_figures == best_res.n_figures && res.n_cross < best_res.n_cross ) ) {
+      best_way = w;
+      best_res = res;
+      MatrixRow *t = best; best = cand; cand = t;
+    }
+  }
+
+  fprintf( stderr, "Choose the %s order.\n", names[best_way] );
+  if ( best_res.n_figures > FIGURES_WARNING )
+    fprintf( stderr, "Warning : %.0lf figures will be generated, the tree of object %d pairs up %.0lf of them. Indexing may be very slow.\n",
+	     best_res.n_figures, best_res.max_tree, best_res.max_figures );
+
+  memcpy( this->r_order, best, sizeof(MatrixRow) * n_rows );
+  delete[] cand;
+  delete[] best;
+  show_res_use( "Dry run" );
+}
+
+/*
+ * The order file lists the input objects, one ID per line, in the order their trees are built.
+ * The merged objects are listed together, and the objects that point to nothing are left out.
+ * Keying the order by the input IDs keeps it valid when the merging changes between two runs.
+ */
+bool
+PesTrie::save_order( const char* file_name, int n_rows )
+{
+  FILE *fp = fopen( file_name, "w" );
+  if ( fp == NULL ) {
+    fprintf( stderr, "Cannot write to the file: %s\n", file_name );
+    return false;
+  }
+
+  int n_objs = ( this->index_type == SE_MATRIX ? this->m / 2 : this->m );
+  int *m_rep = this->m_rep;
+
+  // Bucket the objects by their representatives
+  int *head = new int[n_rows];
+  int *next = new int[n_objs];
+  memset( head, -1, sizeof(int) * n_rows );
+  for ( int i = n_objs - 1; i >= 0; --i ) {
+    int r = ( m_rep == NULL ? i : m_rep[i] );
+    if ( r == -1 ) continue;
+    next[i] = head[r];
+    head[r] = i;
+  }
+
+  for ( int k = 0; k < n_rows; ++k )
+    for ( int i = head[this->r_order[k].id]; i != -1; i = next[i] )
+      fprintf( fp, "%d\n", i );
+
+  fclose( fp );
+  delete[] head;
+  delete[] next;
+  return true;
+}
+
+/*
+ * The objects listed in the order file are reused by warm_start.
+ * Only the new objects are sorted, and the preorder labels of an unchanged input are stable across the runs.
+ * Returns false if the order file cannot be read, r_order is then untouched.
+ */
+bool
+PesTrie::load_order( const char* file_name, int n_rows, int shift, int permute_way )
+{
+  FILE *fp = fopen( file_name, "r" );
+  if ( fp == NULL ) {
+    fprintf( stderr, "Cannot read the order file: %s, the objects are permuted from scratch.\n", file_name );
+    return false;
+  }
+
+  VECTOR(int) objs;
+  int x;
+  while ( fscanf( fp, "%d", &x ) == 1 )
+    objs.push_back( x );
+
+  bool broken = !feof( fp );
+  fclose( fp );
+  if ( broken ) {
+    fprintf( stderr, "The order file %s is broken, the objects are permuted from scratch.\n", file_name );
+    return false;
+  }
+
+  warm_start( objs.begin(), objs.size(), n_rows, shift, permute_way );
+  return true;
+}
+
+/*
+ * The listed objects keep their relative order, a merged group takes the place of its first member.
+ * The other objects are new, they are sorted by the weights and slotted in front of the first listed object that is lighter.
+ */
+void
+PesTrie::warm_start( const int* objs, int n_listed, int n_rows, int shift, int permute_way )
+{
+  int n_objs = ( this->index_type == SE_MATRIX ? this->m / 2 : this->m );
+  int *m_rep = this->m_rep;
+  int n_old = 0, n_new = 0, n_gone = 0;
+
+  char *seen = new char[n_rows];
+  MatrixRow *old_rows = new MatrixRow[n_rows];
+  memset( seen, 0, sizeof(char) * n_rows );
+
+  for ( int i = 0; i < n_listed; ++i ) {
+    int x = objs[i];
+    // The removed objects and the objects pointing to nothing now are skipped
+    int r = ( x < 0 || x >= n_objs ? -1 : ( m_rep == NULL ? x : m_rep[x] ) );
+    if ( r == -1 ) {
+      ++n_gone;
+      continue;
+    }
+    if ( seen[r] ) continue;
+    seen[r] = 1;
+    old_rows[n_old++].id = r;
+  }
+
+  MatrixRow *new_rows = new MatrixRow[n_rows - n_old];
+  for ( int i = 0; i < n_rows; ++i )
+    if ( seen[i] == 0 ) new_rows[n_new++].id = i;
+
+  // The weights of the listed objects are only used for slotting in the new ones
+  int way = ( permute_way == SORT_BY_SIZE ? SORT_BY_SIZE : SORT_BY_HUB_DEGREE );
+  weigh_rows( old_rows, n_old, shift, way );
+  weigh_and_sort_rows( new_rows, n_new, shift, way );
+
   MatrixRow *r_order = this->r_order;
+  int i = 0, j = 0, k = 0;
+  while ( i < n_old || j < n_new ) {
+    if ( j == n_new || ( i < n_old && old_rows[i].wt >= new_rows[j].wt ) )
+      r_order[k++] = old_rows[i++];
+    else
+      r_order[k++] = new_rows[j++];
+  }
 
-  // Allocate auxiliary data structures
-  vector<int> *tree_edges = new vector<int>[n+cm];
-  vector<CrossEdgeRep*> *cross_edges = new vector<CrossEdgeRep*>[cm];
-  int *bl = new int[n];
-  int *pes = new int[n+cm];
-  int *es_size = new int[n+cm];
-  int *Queue = new int[n];
-  int *split = new int[n+cm];
-  
-  // belong is initialized by -1 to indicate those pointers point to nothing
-  memset( bl, -1, sizeof(int) * n );
-  // aux_array records the number of pointers that a pestrie node represents
-  memset( es_size, 0, sizeof(int) * (n+cm) );
-  // indicate if a pestrie node has been splitted
-  memset( split, -1, sizeof(int) * (n+cm) );
+  fprintf( stderr, "Warm start : %d objects keep the prior order, %d are new, %d are gone.\n",
+	   n_old, n_new, n_gone );
+
+  delete[] seen;
+  delete[] old_rows;
+  delete[] new_rows;
+}
+
+/*
+ * Load the pointer/object labels and the figures of an index built for the first n rows and m columns of the input.
+ * Returns NULL if the file cannot be read, or it is not a points-to index of a smaller input.
+ */
+static PriorIndex*
+read_prior_index( const char* file_name, int n, int m )
+{
+  FILE *fp = fopen( file_name, "rb" );
+  if ( fp == NULL ) {
+    fprintf( stderr, "Cannot read the prior index: %s, the index is built from scratch.\n", file_name );
+    return NULL;
+  }
+
+  char magic[4];
+  int head[3];
+  PriorIndex *prior = new PriorIndex;
+  bool good = ( fread( magic, sizeof(char), 4, fp ) == 4 &&
+		memcmp( magic, PESTRIE_PT_1, 4 ) == 0 &&
+		fread( head, sizeof(int), 3, fp ) == 3 &&
+		head[0] >= 0 && head[0] <= n &&
+		head[1] >= 0 && head[1] <= m &&
+		head[2] >= 0 );
+
+  if ( good ) {
+    prior->n = head[0];
+    prior->m = head[1];
+    prior->vn = head[2];
+    prior->pre_aux = new int[prior->n + prior->m];
+    good = ( fread( prior->pre_aux, sizeof(int), prior->n + prior->m, fp ) == (size_t)( prior->n + prior->m ) );
+  }
+
+  long n_labels = 0;
+  if ( good ) {
+    // The rest of the file are the figures
+    long s = ftell( fp );
+    fseek( fp, 0, SEEK_END );
+    n_labels = ( ftell( fp ) - s ) / sizeof(int);
+    fseek( fp, s, SEEK_SET );
+    prior->labels = new int[n_labels];
+    good = ( fread( prior->labels, sizeof(int), n_labels, fp ) == (size_t)n_labels );
+  }
+  fclose( fp );
+
+  if ( good ) {
+    prior->unit_start = new long[prior->vn];
+    long pos = 0;
+    for ( int x = 0; x < prior->vn && good; ++x ) {
+      good = ( pos < n_labels && prior->labels[pos] >= 0 &&
+	       pos + 1 + prior->labels[pos] <= n_labels );
+      prior->unit_start[x] = pos;
+      if ( good ) pos += 1 + prior->labels[pos];
+    }
+  }
+
+  if ( good ) {
+    // Every tree holds an object, the trees are found by the labels of their objects
+    const int *obj_pre = prior->pre_aux + prior->n;
+    vector<int> roots;
+    for ( int i = 0; i < prior->m; ++i )
+      if ( obj_pre[i] != -1 ) roots.push_back( obj_pre[i] );
+    sort( roots.begin(), roots.end() );
+    roots.erase( unique( roots.begin(), roots.end() ), roots.end() );
+
+    int n_trees = roots.size();
+    good = ( n_trees == 0 || ( roots[0] == 0 && roots[n_trees-1] < prior->vn ) );
+    prior->n_trees = n_trees;
+    prior->roots = new int[n_trees+1];
+    prior->new_tree = new int[n_trees];
+    for ( int t = 0; t < n_trees; ++t ) prior->roots[t] = roots[t];
+    prior->roots[n_trees] = prior->vn;
+    memset( prior->new_tree, -1, sizeof(int) * n_trees );
+  }
+
+  if ( !good ) {
+    fprintf( stderr, "The prior index %s is broken or not built for this input, the index is built from scratch.\n", file_name );
+    delete prior;
+    return NULL;
+  }
+
+  return prior;
+}
+
+/*
+ * The objects are listed by the preorder labels of their trees.
+ * The prior trees keep their relative order, which is required for reusing their figures.
+ */
+void
+PesTrie::load_prior_order( int n_rows, int permute_way )
+{
+  const PriorIndex *prior = this->prior;
+  const int *obj_pre = prior->pre_aux + prior->n;
+
+  vector< pair<int, int> > objs;
+  for ( int i = 0; i < prior->m; ++i )
+    if ( obj_pre[i] != -1 ) objs.push_back( make_pair( obj_pre[i], i ) );
+  sort( objs.begin(), objs.end() );
+
+  int n_listed = objs.size();
+  int *ids = new int[n_listed];
+  for ( int i = 0; i < n_listed; ++i )
+    ids[i] = objs[i].second;
+
+  warm_start( ids, n_listed, n_rows, 0, permute_way );
+  delete[] ids;
+}
+
+// The union-find of the trees, the representative is the smallest tree
+static int
+find_tree( int* uf, int x )
+{
+  while ( uf[x] != x ) {
+    uf[x] = uf[uf[x]];
+    x = uf[x];
+  }
+  return x;
+}
+
+static void
+union_trees( int* uf, int x, int y )
+{
+  x = find_tree( uf, x );
+  y = find_tree( uf, y );
+  if ( x < y ) uf[y] = x;
+  else if ( y < x ) uf[x] = y;
+}
+
+/*
+ * Two trees interact only if their objects share a pointer,
+ * hence the connected components of the pointer-object graph can be built independently.
+ * Returns the component of every tree, labeled by its smallest tree.
+ * first[x] receives the first tree of pointer x, or -1 if x points to nothing.
+ */
+int*
+PesTrie::find_components( int* first ) const
+{
+  int n = this->cn;
+  int cm = this->cm;
+  const CsrMatrix *mat_T = this->mat_T;
+  const MatrixRow *r_order = this->r_order;
+
+  int *uf = new int[cm];
+  for ( int k = 0; k < cm; ++k ) uf[k] = k;
+  memset( first, -1, sizeof(int) * n );
+
+  for ( int k = 0; k < cm; ++k ) {
+    int i = r_order[k].id;
+    for ( const int *p = mat_T->row_begin(i), *e = mat_T->row_end(i); p < e; ++p ) {
+      if ( first[*p] == -1 ) first[*p] = k;
+      else union_trees( uf, first[*p], k );
+    }
+  }
+
+  // The store and load trees of an object are paired up by build_index
+  if ( this->index_type == SE_MATRIX ) {
+    int half_m = cm / 2;
+    for ( int k = 0; k < half_m; ++k )
+      union_trees( uf, k, k + half_m );
+  }
+
+  for ( int k = 0; k < cm; ++k )
+    uf[k] = find_tree( uf, k );
+  return uf;
+}
+
+/*
+ * The components are dealt to the workers from the heaviest one, and every one goes to the least loaded worker.
+ * tree_owner receives the worker of every tree, and w_ptrs[w] the #pointers in the components of worker w.
+ * Returns the #workers, it is 1 if the trees cannot be split, tree_owner is then left NULL.
+ */
+int
+PesTrie::assign_components( int n_threads, int* w_ptrs )
+{
+  int n = this->cn;
+  int cm = this->cm;
+  const CsrMatrix *mat_T = this->mat_T;
+  const MatrixRow *r_order = this->r_order;
+
+  int *first = new int[n];
+  int *uf = find_components( first );
+
+  // The weight of a component is its #facts
+  vector< pair<long, int> > comps;
+  long *wt = new long[cm];
+  memset( wt, 0, sizeof(long) * cm );
+  for ( int k = 0; k < cm; ++k ) {
+    int c = find_tree( uf, k );
+    if ( c == k ) comps.push_back( make_pair( 0L, k ) );
+    wt[c] += mat_T->row_size( r_order[k].id );
+  }
+
+  int n_comps = comps.size();
+  if ( n_threads > n_comps ) n_threads = n_comps;
+  if ( n_threads <= 1 ) {
+    delete[] uf;
+    delete[] first;
+    delete[] wt;
+    return 1;
+  }
+
+  for ( int c = 0; c < n_comps; ++c )
+    comps[c].first = -wt[ comps[c].second ];
+  sort( comps.begin(), comps.end() );
+
+  // wt is reused for the worker of every component
+  long *load = new long[n_threads];
+  memset( load, 0, sizeof(long) * n_threads );
+  for ( int c = 0; c < n_comps; ++c ) {
+    int w = 0;
+    for ( int t = 1; t < n_threads; ++t )
+      if ( load[t] < load[w] ) w = t;
+    load[w] -= comps[c].first;
+    wt[ comps[c].second ] = w;
+  }
+
+  int *tree_owner = new int[cm];
+  for ( int k = 0; k < cm; ++k )
+    tree_owner[k] = wt[ find_tree( uf, k ) ];
+
+  memset( w_ptrs, 0, sizeof(int) * n_threads );
+  for ( int x = 0; x < n; ++x )
+    if ( first[x] != -1 ) w_ptrs[ tree_owner[first[x]] ]++;
+
+  fprintf( stderr, "Components : %d, the heaviest one has %.2lf%% of the facts.\n",
+	   n_comps, mat_T->offs[cm] == 0 ? 0.0 : -(double)comps[0].first / mat_T->offs[cm] * 100 );
+
+  this->tree_owner = tree_owner;
+  delete[] uf;
+  delete[] first;
+  delete[] wt;
+  delete[] load;
+  return n_threads;
+}
+
+struct CoreTask
+{
+  int n, cm;
+  const CsrMatrix *mat_T;
+  const MatrixRow *r_order;
+  const int *tree_owner;
+  int *bl, *pes, *es_size, *split, *tree_start, *parent;
+  // Worker w numbers its vertices from vid_base[w], tree k creates [born[k], born[k] + n_born[k])
+  int *vid_base, *born, *n_born;
+  // The cross edges of tree k are ce_buf[w][ce_off[k]..ce_off[k] + cross_start[k+1]) for its worker w
+  CrossEdgeRep **ce_buf;
+  long *ce_off, *cross_start;
+  long ce_cap;
+  // The threads for splitting a hub column, and the first position of every ES in that column
+  int hub_threads;
+  int *hub_first;
+  // The low-memory mode reads the columns from disk_T, and spills the cross edges once ce_limit of them are buffered
+  const DiskCsrMatrix *disk_T;
+  FILE *ce_file;
+  long ce_limit;
+  int n_ce_spills;
+  bool ce_broken;
+};
+
+/*
+ * The cross edges are spilled to a temporary file once half of the memory budget is filled.
+ * Returns false if the file cannot be created.
+ */
+static bool
+open_cross_file( CoreTask* task, long budget )
+{
+  task->ce_file = open_temp_file();
+  if ( task->ce_file == NULL ) return false;
+
+  task->ce_limit = budget / 2 / sizeof(CrossEdgeRep) + 1;
+  if ( task->ce_cap > task->ce_limit ) task->ce_cap = task->ce_limit;
+  return true;
+}
+
+// The cross edges are written as they are, next is rebuilt by the pairing
+static void
+spill_cross_edges( CoreTask* task, const CrossEdgeRep* cross_edges, long n_cross )
+{
+  if ( fwrite( cross_edges, sizeof(CrossEdgeRep), n_cross, task->ce_file ) != (size_t)n_cross )
+    task->ce_broken = true;
+  task->n_ce_spills++;
+}
+
+// Make room for more cross edges after the used ones
+static void
+reserve_cross_edges( CrossEdgeRep** p_buf, long* p_cap, long used, long more )
+{
+  if ( used + more <= *p_cap ) return;
+
+  *p_cap = ( used + more ) * 2;
+  CrossEdgeRep *t = new CrossEdgeRep[*p_cap];
+  memcpy( t, *p_buf, sizeof(CrossEdgeRep) * used );
+  delete[] *p_buf;
+  *p_buf = t;
+}
+
+struct HubTask
+{
+  CoreTask *core;
+  int k, n_threads, phase;
+  const int *col;            // the pointers of the hub column
+  int len;
+  int *es_of;                // the ES of every pointer before the split, -1 if it is new to PesTrie
+  std::vector<int> *firsts;  // the ESes first seen by every thread, in the column order
+  int n_distinct;
+  int *distinct;             // the ESes touched by the column, in the order of their first positions
+  int *counts;               // counts[t * n_distinct + d] is the #pointers of distinct[d] in the slice of thread t
+  int *target;               // the ES that the pointers of distinct[d] are moved to
+};
+
+// The CAS loop lowers first[es] to j, the other threads may be lowering it at the same time
+static void
+claim_first( int* first, int es, int j )
+{
+  int old = __atomic_load_n( first + es, __ATOMIC_RELAXED );
+  while ( old == -1 || j < old ) {
+    if ( __sync_bool_compare_and_swap( first + es, old, j ) ) break;
+    old = __atomic_load_n( first + es, __ATOMIC_RELAXED );
+  }
+}
+
+static void
+hub_worker( int tid, void* arg )
+{
+  HubTask *task = (HubTask*)arg;
+  CoreTask *core = task->core;
+  int *bl = core->bl;
+  int *first = core->hub_first;
+  int *es_of = task->es_of;
+  int lo = (long)task->len * tid / task->n_threads;
+  int hi = (long)task->len * ( tid + 1 ) / task->n_threads;
+  int D = task->n_distinct;
+
+  switch ( task->phase ) {
+  case 0:
+    // The pointers are distinct, so every thread updates its own part of bl
+    for ( int j = lo; j < hi; ++j ) {
+      int x = task->col[j];
+      int es = bl[x];
+      es_of[j] = es;
+      if ( es == -1 )
+	bl[x] = task->k;
+      else
+	claim_first( first, es, j );
+    }
+    break;
+
+  case 1:
+    for ( int j = lo; j < hi; ++j ) {
+      int es = es_of[j];
+      if ( es != -1 && first[es] == j ) task->firsts[tid].push_back( es );
+    }
+    break;
+
+  case 2:
+    {
+      // first[es] is the index of es in distinct now
+      int *cnt = task->counts + (long)tid * D;
+      memset( cnt, 0, sizeof(int) * D );
+      for ( int j = lo; j < hi; ++j )
+	if ( es_of[j] != -1 ) cnt[ first[es_of[j]] ]++;
+    }
+    break;
+
+  case 3:
+    {
+      // Sum up the partial counts into the slice of thread 0, the threads now split the distinct ESes
+      int d_lo = (long)D * tid / task->n_threads;
+      int d_hi = (long)D * ( tid + 1 ) / task->n_threads;
+      for ( int t = 1; t < task->n_threads; ++t ) {
+	const int *cnt = task->counts + (long)t * D;
+	for ( int d = d_lo; d < d_hi; ++d )
+	  task->counts[d] += cnt[d];
+      }
+    }
+    break;
+
+  case 4:
+    for ( int j = lo; j < hi; ++j )
+      if ( es_of[j] != -1 ) bl[ task->col[j] ] = task->target[ first[es_of[j]] ];
+    break;
+  }
+}
+
+/*
+ * The 3-pass scan for a hub column, i.e. the tree k of a heavily pointed-to object.
+ * The scans over the column are split among the threads, and only the distinct ESes are visited serially:
+ * 1. Every thread finds the ES of its pointers, and the first position of every ES in the column is taken by a CAS;
+ * 2. The threads collect the ESes at their first positions, the concatenation is in the column order;
+ * 3. The threads count the covered pointers of every ES, and the partial counts are summed up;
+ * 4. The partially covered ESes are split in the order of their first positions, exactly as the serial scan does;
+ * 5. The threads move the pointers to the new ESes, and a cross edge is created for every distinct ES in the same order.
+ * Returns the #cross edges written to out.
+ */
+static long
+grow_hub_tree( CoreTask* core, int k, int* p_vertex_num, CrossEdgeRep* out )
+{
+  const CsrMatrix *mat_T = core->mat_T;
+  int i = core->r_order[k].id;
+  int cm = core->cm;
+  int *pes = core->pes;
+  int *es_size = core->es_size;
+  int *first = core->hub_first;
+  int vertex_num = *p_vertex_num;
+
+  HubTask task;
+  task.core = core;
+  task.k = k;
+  task.n_threads = core->hub_threads;
+  task.col = mat_T->row_begin(i);
+  task.len = mat_T->row_size(i);
+  task.es_of = new int[task.len];
+  task.firsts = new vector<int>[task.n_threads];
+  task.n_distinct = 0;
+
+  task.phase = 0;
+  parallel_execute( task.n_threads, hub_worker, &task );
+  task.phase = 1;
+  parallel_execute( task.n_threads, hub_worker, &task );
+
+  int D = 0;
+  for ( int t = 0; t < task.n_threads; ++t )
+    D += task.firsts[t].size();
+  int *distinct = task.distinct = new int[D+1];
+  D = 0;
+  for ( int t = 0; t < task.n_threads; ++t )
+    for ( size_t j = 0; j < task.firsts[t].size(); ++j ) {
+      int es = task.firsts[t][j];
+      first[es] = D;
+      distinct[D++] = es;
+    }
+  task.n_distinct = D;
+  delete[] task.firsts;
+
+  task.counts = new int[(long)task.n_threads * D + 1];
+  task.phase = 2;
+  parallel_execute( task.n_threads, hub_worker, &task );
+  task.phase = 3;
+  parallel_execute( task.n_threads, hub_worker, &task );
+  int *covered = task.counts;
+
+  // Split the partially covered ESes
+  int *target = task.target = new int[D+1];
+  long n_old = 0;
+  pes[k] = k;
+  for ( int d = 0; d < D; ++d ) {
+    int es = distinct[d];
+    n_old += covered[d];
+    es_size[es] -= covered[d];
+    if ( es_size[es] > 0 ) {
+      pes[ vertex_num ] = pes[ es ];
+      core->split[es] = vertex_num;
+      core->parent[ vertex_num - cm ] = es;
+      core->tree_start[es+1]++;
+      target[d] = vertex_num++;
+    }
+    else
+      target[d] = es;
+  }
+
+  task.phase = 4;
+  parallel_execute( task.n_threads, hub_worker, &task );
+
+  // The new ESes and the emptied ESes get the cross edges, the root holds the pointers new to PesTrie
+  es_size[k] = 1 + ( task.len - n_old );
+  for ( int d = 0; d < D; ++d ) {
+    int t = target[d];
+    out[d].t = t;
+    out[d].start = core->tree_start[t+1];
+    out[d].next = NULL;
+    es_size[t] += covered[d];
+    first[ distinct[d] ] = -1;
+  }
+
+  *p_vertex_num = vertex_num;
+  delete[] task.es_of;
+  delete[] task.counts;
+  delete[] distinct;
+  delete[] target;
+  return D;
+}
+
+/*
+ * A 3-pass scan algorithm to build the trees of a worker.
+ * 2-pass is also possible, but it requires one more linear space vector.
+ */
+static void
+grow_trees( int tid, void* arg )
+{
+  CoreTask *task = (CoreTask*)arg;
+  int i, j, k;
+  int es, last_vertex_num, Q_end;
+  unsigned x;
+  const int *p, *e;
+
+  int cm = task->cm;
+  const CsrMatrix *mat_T = task->mat_T;
+  const MatrixRow *r_order = task->r_order;
+  int *bl = task->bl;
+  int *pes = task->pes;
+  int *es_size = task->es_size;
+  int *split = task->split;
+  int *tree_start = task->tree_start;
+  int *parent = task->parent;
+
+  // A root has at most one cross edge per pointer, the array is grown if the guess is too small
+  long ce_cap = task->ce_cap;
+  long n_cross = 0;
+  CrossEdgeRep *cross_edges = new CrossEdgeRep[ce_cap];
+  int *Queue = new int[task->n];
 
   // First cm entries are reserved for the PesTrie subtree roots
   // But not every root has a non-empty subtree
-  int vertex_num = cm;
+  int vertex_num = task->vid_base[tid];
   for ( k = 0; k < cm; ++k ) {
+    if ( task->tree_owner != NULL &&
+	 task->tree_owner[k] != tid ) continue;
    
     i = r_order[k].id;
     // We use this lower-bound to distinguish the phase
     last_vertex_num = vertex_num;
+    task->ce_off[k] = n_cross;
+
+    if ( task->hub_threads > 1 &&
+	 mat_T->row_size(i) >= HUB_COLUMN_SIZE ) {
+      reserve_cross_edges( &cross_edges, &ce_cap, n_cross, mat_T->row_size(i) );
+      n_cross += grow_hub_tree( task, k, &vertex_num, cross_edges + n_cross );
+      task->born[k] = last_vertex_num;
+      task->n_born[k] = vertex_num - last_vertex_num;
+      task->cross_start[k+1] = n_cross - task->ce_off[k];
+      continue;
+    }
+
+    if ( task->disk_T != NULL ) {
+      // The column is read into Queue, the first pass then scans it in place
+      task->disk_T->read_row( i, Queue );
+      p = Queue;
+      e = Queue + task->disk_T->row_size(i);
+    }
+    else {
+      p = mat_T->row_begin(i);
+      e = mat_T->row_end(i);
+    }
 
     // First pass, scan all reachable pointers
     Q_end = 0;
     pes[k] = k;
-    EXECUTE_IF_SET_IN_BITMAP(mat_T[i],0,x,bi) {
+    for ( ; p < e; ++p ) {
+      x = *p;
       Queue[Q_end++] = x;
       es = bl[x];
       if ( es != -1 ) {
@@ -123,9 +1355,6 @@ PesTrie::build_pestrie_core()
       }
     }
     
-    // the matrix is of no use any more
-    // BITMAP_FREE( mat_T[i] );
-
     // Second pass, produce new pes-nodes and tree edges
     for ( j = 0; j < Q_end; ++j ) {
       x = Queue[j];
@@ -138,36 +1367,248 @@ PesTrie::build_pestrie_core()
 	  pes[ vertex_num ] = pes[ es ];
 	  split[es] = vertex_num;
 	  // Create a tree edge
-	  tree_edges[es].push_back( vertex_num );
+	  parent[ vertex_num - cm ] = es;
+	  tree_start[es+1]++;
 	  vertex_num++;
 	}
 	bl[x] = split[es];
       }
     }
+    task->born[k] = last_vertex_num;
+    task->n_born[k] = vertex_num - last_vertex_num;
     
     // Third pass, create the cross edges
     es_size[k] = 1;        // essential, otherwise the root can be empty in the partition process
+    reserve_cross_edges( &cross_edges, &ce_cap, n_cross, Q_end );
     for ( j = 0; j < Q_end; ++j ) {
       x = Queue[j];
       es = bl[x];
       if ( es_size[es] == 0 ) {
 	// Creat a cross edge if this node is newly created or an empty node
-	CrossEdgeRep* tp = new CrossEdgeRep;
+	CrossEdgeRep* tp = cross_edges + n_cross++;
 	tp -> t = es;
-	tp -> start = tree_edges[es].size();
-	cross_edges[k].push_back( tp );
+	tp -> start = tree_start[es+1];
+	tp -> next = NULL;
       }
       es_size[es]++;
     }
+    task->cross_start[k+1] = n_cross - task->ce_off[k];
+
+    if ( task->ce_file != NULL && n_cross >= task->ce_limit ) {
+      spill_cross_edges( task, cross_edges, n_cross );
+      n_cross = 0;
+    }
+  }
+
+  if ( task->ce_file != NULL && n_cross > 0 )
+    spill_cross_edges( task, cross_edges, n_cross );
+  task->ce_buf[tid] = cross_edges;
+  delete[] Queue;
+}
+
+/*
+ * With multiple workers, every worker numbers its vertices in a private range.
+ * The vertices are renumbered by the creation order of a serial build, i.e. by their trees and then by their ranges,
+ * thus the PesTrie is exactly the one built by a single worker.
+ */
+static int
+stitch_vertices( CoreTask* task, int n_workers, CrossEdgeRep** p_cross_edges )
+{
+  int n = task->n, cm = task->cm;
+  int *new_id = new int[n];
+  int vertex_num = cm;
+
+  for ( int k = 0; k < cm; ++k )
+    for ( int v = task->born[k], e = v + task->n_born[k]; v < e; ++v )
+      new_id[v-cm] = vertex_num++;
+
+#define REMAP(v) ( (v) < cm ? (v) : new_id[(v)-cm] )
+
+  int *pes = task->pes;
+  int *es_size = task->es_size;
+  int *parent = task->parent;
+  int *buf = new int[n];
+
+  // Move the per-vertex values to their new places, the roots are untouched
+  int *arrays[] = { pes, es_size, parent };
+  for ( int a = 0; a < 3; ++a ) {
+    int *base = ( a == 2 ? arrays[a] : arrays[a] + cm );
+    for ( int k = 0; k < cm; ++k )
+      for ( int v = task->born[k], e = v + task->n_born[k]; v < e; ++v )
+	buf[ new_id[v-cm] - cm ] = base[v-cm];
+    memcpy( base, buf, sizeof(int) * ( vertex_num - cm ) );
+  }
+
+  for ( int v = 0; v < vertex_num - cm; ++v )
+    parent[v] = REMAP( parent[v] );
+
+  int *bl = task->bl;
+  for ( int x = 0; x < n; ++x )
+    if ( bl[x] != -1 ) bl[x] = REMAP( bl[x] );
+
+  // The cross edges are gathered tree by tree
+  long *cross_start = task->cross_start;
+  for ( int k = 0; k < cm; ++k )
+    cross_start[k+1] += cross_start[k];
+
+  CrossEdgeRep *cross_edges = new CrossEdgeRep[ cross_start[cm] + 1 ];
+  for ( int k = 0; k < cm; ++k ) {
+    const CrossEdgeRep *src = task->ce_buf[ task->tree_owner[k] ] + task->ce_off[k];
+    for ( long c = cross_start[k]; c < cross_start[k+1]; ++c, ++src ) {
+      cross_edges[c] = *src;
+      cross_edges[c].t = REMAP( src->t );
+    }
+  }
+
+#undef REMAP
+
+  for ( int w = 0; w < n_workers; ++w )
+    delete[] task->ce_buf[w];
+  delete[] new_id;
+  delete[] buf;
+
+  *p_cross_edges = cross_edges;
+  return vertex_num;
+}
+
+/*
+ * The trees are grown by the workers and stitched together if the pointer-object graph has multiple components.
+ * Then the tree edges are frozen and the interval labels are generated.
+ */
+void 
+PesTrie::build_pestrie_core()
+{
+  int i, j;
+  int Q_end;
+  unsigned x, y;
+  
+  // Obtain existing data
+  int n = this->cn;
+  int cm = this->cm;
+  CsrMatrix* mat_T = this->mat_T;
+  DiskCsrMatrix* disk_T = this->disk_T;
+  long n_facts = ( disk_T != NULL ? disk_T->size() : mat_T->size() );
+
+  int n_threads = this->pes_opts->n_threads;
+  bool low_memory = ( disk_T != NULL );
+  int *vid_base = new int[n_threads];
+  int n_workers = 1;
+  // The components are not labeled on the disk, so the columns are read by one worker
+  if ( n_threads > 1 && !low_memory )
+    n_workers = assign_components( n_threads, vid_base );
+
+  // The range of worker w starts after the pointers of the workers before it
+  int s = cm;
+  for ( int w = 0; w < n_workers; ++w ) {
+    int sz = ( n_workers == 1 ? n : vid_base[w] );
+    vid_base[w] = s;
+    s += sz;
+  }
+
+  // Allocate auxiliary data structures
+  CoreTask task;
+  task.n = n;
+  task.cm = cm;
+  task.mat_T = mat_T;
+  task.r_order = this->r_order;
+  task.tree_owner = this->tree_owner;
+  task.vid_base = vid_base;
+  // tree_start[x+1] counts the children of ES x until the tree is frozen, see below
+  int *tree_start = task.tree_start = new int[n+cm+1];
+  int *parent = task.parent = new int[n];
+  int *bl = task.bl = new int[n];
+  int *pes = task.pes = new int[n+cm];
+  int *es_size = task.es_size = new int[n+cm];
+  int *split = task.split = new int[n+cm];
+  task.born = new int[cm];
+  task.n_born = new int[cm];
+  task.ce_buf = new CrossEdgeRep*[n_workers];
+  task.ce_off = new long[cm];
+  long *cross_start = task.cross_start = new long[cm+1];
+  task.ce_cap = ( n_facts / 4 + cm ) / n_workers + 1;
+  // The hub columns are split only if the components are not
+  task.hub_threads = ( n_workers == 1 && !low_memory ? n_threads : 1 );
+  task.hub_first = NULL;
+  task.disk_T = disk_T;
+  task.ce_file = NULL;
+  task.n_ce_spills = 0;
+  task.ce_broken = false;
+  if ( low_memory && !open_cross_file( &task, this->pes_opts->mem_budget ) )
+    fprintf( stderr, "Cannot create the temporary file, the cross edges are kept in memory.\n" );
+  if ( task.hub_threads > 1 ) {
+    task.hub_first = new int[n+cm];
+    memset( task.hub_first, -1, sizeof(int) * (n+cm) );
+  }
+  
+  // belong is initialized by -1 to indicate those pointers point to nothing
+  memset( bl, -1, sizeof(int) * n );
+  // aux_array records the number of pointers that a pestrie node represents
+  memset( es_size, 0, sizeof(int) * (n+cm) );
+  // indicate if a pestrie node has been splitted
+  memset( split, -1, sizeof(int) * (n+cm) );
+  memset( tree_start, 0, sizeof(int) * (n+cm+1) );
+  cross_start[0] = 0;
+
+  parallel_execute( n_workers, grow_trees, &task );
+
+  int vertex_num;
+  CrossEdgeRep *cross_edges;
+  if ( n_workers > 1 )
+    vertex_num = stitch_vertices( &task, n_workers, &cross_edges );
+  else {
+    // A single worker already numbers the vertices and the cross edges in order
+    vertex_num = ( cm == 0 ? cm : task.born[cm-1] + task.n_born[cm-1] );
+    for ( int k = 0; k < cm; ++k )
+      cross_start[k+1] += cross_start[k];
+    cross_edges = task.ce_buf[0];
+  }
+
+  if ( low_memory ) {
+    // The columns are not read any more
+    delete disk_T;
+    this->disk_T = NULL;
+  }
+
+  if ( task.ce_file != NULL ) {
+    fprintf( stderr, "Low-memory build : the columns of %ld facts are read from the disk, the cross edges are spilled in %d parts.\n",
+	     n_facts, task.n_ce_spills );
+    if ( task.ce_broken || fflush( task.ce_file ) != 0 ) {
+      fprintf( stderr, "Cannot spill the cross edges to the disk.\n" );
+      exit( -1 );
+    }
+    delete[] cross_edges;
+    cross_edges = NULL;
+    this->cross_file = task.ce_file;
   }
 
+  delete[] vid_base;
+  delete[] task.born;
+  delete[] task.n_born;
+  delete[] task.ce_buf;
+  delete[] task.ce_off;
+  if ( task.hub_first != NULL ) delete[] task.hub_first;
+
+  // Freeze the tree edges, the children of every ES are kept in the creation order
+  int *tree_edges = new int[vertex_num - cm];
+  memset( tree_start, 0, sizeof(int) * (vertex_num+1) );
+  for ( i = cm; i < vertex_num; ++i )
+    tree_start[ parent[i-cm] + 1 ]++;
+  for ( i = 0; i < vertex_num; ++i ) {
+    tree_start[i+1] += tree_start[i];
+    split[i] = tree_start[i];
+  }
+  for ( i = cm; i < vertex_num; ++i )
+    tree_edges[ split[parent[i-cm]]++ ] = i;
+  delete[] parent;
+
   // The last step, we generate the interval labels of PesTrie
   int *preV = new int[vertex_num];
   int *lastV = new int[vertex_num];
+  int *Queue = new int[n];
 
   // split is used for tracking the next walkable tree edge for every ES
   for ( i = 0; i < vertex_num; ++i )
-    split[i] = tree_edges[i].size() - 1;
+    split[i] = tree_start[i+1] - 1;
   
   // A non-recursive version of tree traversal
   int pre_order = 0;
@@ -179,9 +1620,9 @@ PesTrie::build_pestrie_core()
     while ( Q_end > 0 ) {
       x = Queue[Q_end-1];
       j = split[x];
-      if ( j > -1 ) {
+      if ( j >= tree_start[x] ) {
 	// We take this edge and walk down
-	y = tree_edges[x][j];
+	y = tree_edges[j];
 	split[x] = j - 1;
 	Queue[Q_end++] = y;
 	preV[y] = pre_order++;
@@ -196,8 +1637,11 @@ PesTrie::build_pestrie_core()
 
   // Now we update the PesTrie descriptor
   this->vn = vertex_num;
+  this->n_workers = n_workers;
+  this->tree_start = tree_start;
   this->tree_edges = tree_edges;
   this->cross_edges = cross_edges;
+  this->cross_start = cross_start;
   this->bl = bl;
   this->pes = pes;
   this->es_size = es_size;
@@ -210,6 +1654,253 @@ PesTrie::build_pestrie_core()
   delete[] split;
 }
 
+// pread may return less than asked
+static bool
+read_fully_at( int fd, void* buf, size_t len, off_t off )
+{
+  char *p = (char*)buf;
+  while ( len > 0 ) {
+    ssize_t k = pread( fd, p, len, off );
+    if ( k <= 0 ) return false;
+    p += k;
+    off += k;
+    len -= k;
+  }
+  return true;
+}
+
+CrossEdgeRep*
+PesTrie::fetch_cross_edges( int k, vector<CrossEdgeRep>& buf ) const
+{
+  if ( this->cross_file == NULL )
+    return this->cross_edges + this->cross_start[k];
+
+  int size = n_cross_edges( k );
+  if ( buf.size() < (size_t)size + 1 ) buf.resize( size + 1 );
+  if ( !read_fully_at( fileno( this->cross_file ), &buf[0], sizeof(CrossEdgeRep) * size,
+		       sizeof(CrossEdgeRep) * this->cross_start[k] ) ) {
+    fprintf( stderr, "Cannot read the spilled cross edges.\n" );
+    exit( -1 );
+  }
+  return &buf[0];
+}
+
+struct PairingTask
+{
+  PesTrie *pestrie;
+  SegTree **seg_trees;
+  int *n_gen_rects;
+};
+
+static void
+pairing_worker( int tid, void* arg )
+{
+  PairingTask *task = (PairingTask*)arg;
+  task->n_gen_rects[tid] = task->pestrie->pair_up_trees( tid, task->seg_trees[tid] );
+}
+
+/*
+ * The figures of two components never cover each other, so the workers test and insert them independently.
+ * Merging the segment trees gives the same figures as pairing up all the trees with one worker.
+ */
+int
+PesTrie::build_index()
+{
+  int n_workers = this->n_workers;
+  PairingTask task;
+  task.pestrie = this;
+  task.seg_trees = new SegTree*[n_workers];
+  task.n_gen_rects = new int[n_workers];
+  for ( int w = 0; w < n_workers; ++w )
+    task.seg_trees[w] = build_segtree( 0, this->vn );
+
+  parallel_execute( n_workers, pairing_worker, &task );
+
+  SegTree *seg_tree = task.seg_trees[0];
+  int n_gen_rects = task.n_gen_rects[0];
+  for ( int w = 1; w < n_workers; ++w ) {
+    seg_tree->absorb( task.seg_trees[w] );
+    delete task.seg_trees[w];
+    n_gen_rects += task.n_gen_rects[w];
+  }
+
+  this->seg_tree = seg_tree;
+  this->n_gen_rects = n_gen_rects;
+  delete[] task.seg_trees;
+  delete[] task.n_gen_rects;
+  return 0;
+}
+
+/*
+ * A tree is kept if it is rebuilt from a prior tree of the same size and no new fact touches it,
+ * i.e. neither its object nor the pointers in it, before or after the update, receive new facts.
+ * The ESes of a kept tree are split by the same trees in the same order, so its labels are the prior ones shifted,
+ * and the alias pairs between two kept trees are unchanged.
+ * Their figures are copied by reuse_prior_figures, and build_index only pairs up the other tree pairs.
+ * A tree is also changed if it does not match the prior trees, in case the prior index is stale.
+ */
+void
+PesTrie::match_prior_trees()
+{
+  int n = this->n;
+  int cm = this->cm;
+  int m = this->m;
+  int *m_rep = this->m_rep;
+  int *pes = this->pes;
+  int *preV = this->preV;
+  int *lastV = this->lastV;
+  const MatrixRow *r_order = this->r_order;
+  PriorIndex *prior = this->prior;
+  int n_trees = prior->n_trees;
+  int *roots = prior->roots;
+  int *new_tree = prior->new_tree;
+  const int *obj_pre = prior->pre_aux + prior->n;
+
+  int *obj_pos = new int[cm];
+  for ( int k = 0; k < cm; ++k )
+    obj_pos[ r_order[k].id ] = k;
+
+  // Pair up the prior trees and the new trees by their objects, -2 stands for a conflict
+  int *old_tree = new int[cm];
+  memset( old_tree, -1, sizeof(int) * cm );
+  for ( int i = 0; i < prior->m; ++i ) {
+    if ( obj_pre[i] == -1 ) continue;
+    int t = upper_bound( roots, roots + n_trees, obj_pre[i] ) - roots - 1;
+    int r = ( m_rep == NULL ? i : m_rep[i] );
+    int k = ( r == -1 ? -1 : obj_pos[r] );
+
+    if ( k == -1 ) new_tree[t] = -2;
+    else if ( new_tree[t] == -1 ) new_tree[t] = k;
+    else if ( new_tree[t] != k ) new_tree[t] = -2;
+
+    if ( k == -1 ) continue;
+    if ( old_tree[k] == -1 ) old_tree[k] = t;
+    else if ( old_tree[k] != t ) old_tree[k] = -2;
+  }
+
+  char *kept = new char[cm];
+  for ( int k = 0; k < cm; ++k ) {
+    int t = old_tree[k];
+    kept[k] = ( t >= 0 && new_tree[t] == k &&
+		lastV[k] - preV[k] == roots[t+1] - roots[t] - 1 );
+  }
+
+  // The trees touched by the new facts
+  if ( this->dirty_objs != NULL ) {
+    for ( int i = 0; i < m; ++i ) {
+      int r = ( m_rep == NULL ? i : m_rep[i] );
+      if ( this->dirty_objs[i] && r != -1 ) kept[ obj_pos[r] ] = 0;
+    }
+  }
+
+  if ( this->dirty_ptrs != NULL ) {
+    for ( int x = 0; x < n; ++x ) {
+      if ( this->dirty_ptrs[x] == 0 ) continue;
+      int es = get_es( x );
+      if ( es != -1 ) kept[ pes[es] ] = 0;
+
+      // A pointer moves to the tree of its new object if that tree is earlier
+      if ( x < prior->n && prior->pre_aux[x] != -1 ) {
+	int t = upper_bound( roots, roots + n_trees, prior->pre_aux[x] ) - roots - 1;
+	if ( new_tree[t] >= 0 ) kept[ new_tree[t] ] = 0;
+      }
+    }
+  }
+
+  // The workers skip a kept tree if its cross edges only go into the kept trees
+  if ( this->tree_owner == NULL ) {
+    this->tree_owner = new int[cm];
+    memset( this->tree_owner, 0, sizeof(int) * cm );
+  }
+
+  vector<CrossEdgeRep> buf;
+  int n_kept = 0, n_skipped = 0;
+  for ( int k = 0; k < cm; ++k ) {
+    if ( kept[k] == 0 ) continue;
+    ++n_kept;
+
+    const CrossEdgeRep *ce = fetch_cross_edges( k, buf );
+    int size = n_cross_edges( k ), i;
+    for ( i = 0; i < size; ++i )
+      if ( kept[ pes[ce[i].t] ] == 0 ) break;
+
+    if ( i == size ) {
+      this->tree_owner[k] = -1;
+      ++n_skipped;
+    }
+  }
+
+  for ( int t = 0; t < n_trees; ++t ) {
+    int k = new_tree[t];
+    if ( k < 0 || kept[k] == 0 ) new_tree[t] = -1;
+  }
+  prior->kept = kept;
+
+  fprintf( stderr, "Update : %d of %d trees are unchanged, %d of them are not paired up again.\n",
+	   n_kept, cm, n_skipped );
+
+  delete[] obj_pos;
+  delete[] old_tree;
+}
+
+/*
+ * The figures between two kept trees are shifted to the new preorder labels of the two trees.
+ * A figure merged by dump_figures may span adjacent trees in the y axis, it is cut at the prior tree boundaries,
+ * and the pieces are merged again when they are dumped if their trees are still adjacent.
+ */
+void
+PesTrie::reuse_prior_figures()
+{
+  int *preV = this->preV;
+  SegTree *seg_tree = this->seg_tree;
+  const PriorIndex *prior = this->prior;
+  int n_trees = prior->n_trees;
+  const int *roots = prior->roots;
+  const int *new_tree = prior->new_tree;
+  struct Rectangle r;
+  int n_copied = 0;
+
+  for ( int x = 0, t = -1; x < prior->vn; ++x ) {
+    while ( t + 1 < n_trees && roots[t+1] <= x ) ++t;
+    if ( t == -1 || new_tree[t] == -1 ) continue;
+    int dx = preV[ new_tree[t] ] - roots[t];
+
+    const int *p = prior->labels + prior->unit_start[x];
+    const int *e = p + 1 + p[0];
+    for ( ++p; p < e; ) {
+      int sig = *p & SIG_FIGURE;
+      int y1 = *p++ & ~SIG_FIGURE;
+      int x2 = x, y2 = y1;
+
+      if ( sig == SIG_VERTICAL ) y2 = *p++;
+      else if ( sig == SIG_HORIZONTAL ) x2 = *p++;
+      else if ( sig == SIG_RECT ) {
+	x2 = *p++;
+	y2 = *p++;
+      }
+
+      r.x1 = x + dx;
+      r.x2 = x2 + dx;
+      int u = upper_bound( roots, roots + n_trees, y1 ) - roots - 1;
+      while ( y1 <= y2 && u < n_trees ) {
+	int last = min( y2, roots[u+1] - 1 );
+	if ( new_tree[u] != -1 ) {
+	  int dy = preV[ new_tree[u] ] - roots[u];
+	  r.y1 = y1 + dy;
+	  r.y2 = last + dy;
+	  seg_tree->insert_segtree( r );
+	  ++n_copied;
+	}
+	y1 = last + 1;
+	++u;
+      }
+    }
+  }
+
+  fprintf( stderr, "Update : %d figures are copied from the prior index, %d are generated, %.1lf%% are reused.\n",
+	   n_copied, n_gen_rects, n_copied + n_gen_rects == 0 ? 0.0 : 100.0 * n_copied / ( n_copied + n_gen_rects ) );
+}
+
 void PesTrie::profile_index()
 {
   int n = this->n;
@@ -267,11 +1958,11 @@ PesTrie::advanced_profile_pestrie()
   int *bl = this->bl;
   int *pes = this->pes;
   int *es_size = this->es_size;
-  bitmap* mat_T = this->mat_T;
+  CsrMatrix* mat_T = this->mat_T;
   int *r_count = this->r_count;
 
-  // We profile the objects (pointed-to sizes + hub degrees)
-  if ( 1 ) {
+  // We profile the objects (pointed-to sizes + hub degrees), mat_T is freed in the low-memory mode
+  if ( mat_T != NULL ) {
     double max_wt = 0;
     double ari_avg = 0;
     double geo_avg = 0;
@@ -293,14 +1984,16 @@ PesTrie::advanced_profile_pestrie()
 
     // We recompute the hub degrees and pointed-to size
     for ( int i = 0; i < cm; ++i ) {
-      unsigned x;
-      bitmap_iterator bi;
+      const int *p;
+      const int *s = mat_T->row_begin(i);
+      const int *e = mat_T->row_end(i);
 
       int n_bits = 0;
       long wt = 0;
 
       // Count bits
-      EXECUTE_IF_SET_IN_BITMAP( mat_T[i], 0, x, bi ) {
+      for ( p = s; p < e; ++p ) {
+	int x = *p;
 	int rep_x = bl[x];
 	if ( vis[rep_x] == 0 ) {
 	  ++n_bits;
@@ -308,7 +2001,8 @@ PesTrie::advanced_profile_pestrie()
 	}
       }
 
-      EXECUTE_IF_SET_IN_BITMAP( mat_T[i], 0, x, bi ) {
+      for ( p = s; p < e; ++p ) {
+	int x = *p;
 	int rep_x = bl[x];
 	if ( vis[rep_x] == 1 ) {
 	  long ptsize = r_count[x];
@@ -351,13 +2045,39 @@ PesTrie::advanced_profile_pestrie()
   cross_edge_size.push_scales( cross_scales, 4 );
   
   for ( int i = 0; i < cm; ++i ) {
-    int sz = this->cross_edges[i].size();
+    int sz = n_cross_edges( i );
     cross_edge_size.add_sample( sz );
       tot_cross_edges += sz;
   }
   
   fprintf( stderr, "Total cross edges = %d\n", tot_cross_edges );
   cross_edge_size.print_result( stderr, "PesTrie Cross Edge Distribution", false );
+
+  // How much this order saves against the hub degree order, the latter is only simulated
+  int permute_way = this->pes_opts->permute_way;
+  if ( permute_way != SORT_BY_HUB_DEGREE && cm > 0 && mat_T != NULL ) {
+    int n_rows = cm, shift = 0;
+    if ( this->index_type == SE_MATRIX ) {
+      n_rows = cm / 2;
+      shift = n_rows;
+    }
+
+    MatrixRow *hub_order = new MatrixRow[n_rows];
+    for ( int i = 0; i < n_rows; ++i ) {
+      hub_order[i].id = i;
+      hub_order[i].wt = 0;
+    }
+    weigh_and_sort_rows( hub_order, n_rows, shift, SORT_BY_HUB_DEGREE );
+
+    DryRun hub;
+    simulate_trees( mat_T, hub_order, n_rows, shift, &hub );
+    delete[] hub_order;
+
+    fprintf( stderr, "Hub degree order : cross edges = %ld, this order saves %.2lf%%\n",
+	     hub.n_cross, ( 1.0 - (double)tot_cross_edges / hub.n_cross ) * 100 );
+    fprintf( stderr, "Hub degree order : figures = %.0lf, this order generates %d (saves %.2lf%%)\n",
+	     hub.n_figures, n_gen_rects, ( 1.0 - n_gen_rects / hub.n_figures ) * 100 );
+  }
   
   // Output
   //tree_size.print_result( stderr, "PesTrie Tree Size Distribution", false );
@@ -386,7 +2106,6 @@ PesTrie::externalize_index( FILE* fp, const char* magic_number)
   int vn = this->vn;
   int *m_rep = this->m_rep;
   int *preV = this->preV;
-  int *bl = this->bl;
   MatrixRow *r_order = this->r_order;
   SegTree* seg_tree = this->seg_tree;
 
@@ -396,7 +2115,7 @@ PesTrie::externalize_index( FILE* fp, const char* magic_number)
 
   // First are the pointers
   for ( int i = 0; i < n; ++i ) {
-    int x = bl[i];
+    int x = get_es( i );
     // a pointer may not have a timestamp
     pre_aux[i] = ( x == -1 ? -1: preV[x] );
   }
@@ -490,15 +2209,34 @@ build_index_with_pestrie( PesTrie* pestrie )
 {
   // Merge the equivalent objects
   pestrie->merge_equivalent_rows();
+
+  // The update mode starts from the prior index
+  if ( pestrie->pes_opts->prior_index != NULL )
+    pestrie->prior = read_prior_index( pestrie->pes_opts->prior_index, pestrie->n, pestrie->m );
   
   // First we generate a proper processing order
   pestrie->preprocess();
+  if ( pestrie->pes_opts->order_out != NULL ) {
+    int n_rows = pestrie->cm;
+    if ( pestrie->index_type == SE_MATRIX ) n_rows /= 2;
+    pestrie->save_order( pestrie->pes_opts->order_out, n_rows );
+  }
+
+  // The permutation is computed with all the pointers, so it is not affected by the collapsing
+  if ( pestrie->pes_opts->ptr_merge )
+    pestrie->merge_equivalent_pointers();
 
   // Then we construct the PesTrie
   pestrie->build_pestrie_core();
 
+  // Only the changed components are paired up in the update mode
+  if ( pestrie->prior != NULL )
+    pestrie->match_prior_trees();
+
   // Finally we decompose the PesTrie and generate the index
   pestrie->build_index();
+  if ( pestrie->prior != NULL )
+    pestrie->reuse_prior_figures();
 
   // Output the statistics of PesTrie index
   pestrie->basic_profile_pestrie();
@@ -13,7 +13,6 @@
 #include <cstring>
 #include <vector>
 #include <algorithm>
-#include <climits>
 #include "pestrie.hh"
 #include "profile_helper.h"
 
@@ -27,43 +26,26 @@ void
 PesTrieDual::dual_permute_rows()
 {
   int i, k;
-  unsigned x;
-  bitmap_iterator bi;
   
   int n = this->n;
-  int m = this->m;
-  int half_m = m / 2;
-  bitmap* mat_T = this->mat_T;
+  int cm = this->cm;
+  int half_m = cm / 2;
   MatrixRow* r_order = this->r_order;
-  int *r_count = this->r_count;
 
   int permute_way = this->pes_opts->permute_way;
 
-  if ( permute_way != SORT_BY_RANDOM ) {
-    if ( permute_way == SORT_BY_HUB_DEGREE ) {
-      for ( i = 0; i < half_m; ++i ) {
-	long wt = 0;
-	EXECUTE_IF_SET_IN_BITMAP( mat_T[i], 0, x, bi ) {
-	  long c = r_count[x];
-	  wt += c * c;
-	}
-	EXECUTE_IF_SET_IN_BITMAP( mat_T[i+half_m], 0, x, bi ) {
-	  long c = r_count[x];
-	  wt += c * c;
-	}
-	r_order[i].wt = wt;
-      }
-    }
-    else if ( permute_way == SORT_BY_SIZE ) {
-      for ( i = 0; i < half_m; ++i ) {
-	// number of elements for each row in the input matrix
-	r_order[i].wt = bitmap_count_bits( mat_T[i] );
-	r_order[i].wt += bitmap_count_bits( mat_T[i+half_m] );
-      }
-    }
-    
+  // The store and load shadows of an object are weighed together
+  if ( this->pes_opts->order_in != NULL &&
+       load_order( this->pes_opts->order_in, half_m, half_m, permute_way ) ) {
+    // The order of a prior run is reused, see load_order
+  }
+  else if ( permute_way == SORT_BY_DRY_RUN )
+    dry_run_orders( half_m, half_m );
+  else if ( permute_way == SORT_BY_CROSS_EDGES )
+    order_by_cross_edges( r_order, half_m, half_m, NULL );
+  else if ( permute_way != SORT_BY_RANDOM ) {
     // Sort the rows of the input matrix by the weights from largest to smallest
-    stable_sort( r_order, r_order + half_m );
+    weigh_and_sort_rows( r_order, half_m, half_m, permute_way );
   }
   else {
     //random order
@@ -78,7 +60,7 @@ PesTrieDual::dual_permute_rows()
   /*
   if ( pes_opts -> obj_merge == true ) {
     // We sort the store matrix part here
-    for ( i = half_m; i < m; ++i )
+    for ( i = half_m; i < cm; ++i )
       r_order[i].wt = bitmap_count_bits( mat_T[i] );
 
     // must be stable
@@ -90,7 +72,7 @@ PesTrieDual::dual_permute_rows()
   */
 
   // For the second half, we directly copy the first half order
-  for ( i = half_m; i < m; ++i )
+  for ( i = half_m; i < cm; ++i )
     r_order[i].id = r_order[i-half_m].id + half_m;
 }
 
@@ -108,12 +90,11 @@ PesTrieDual::basic_profile_pestrie()
   fprintf( stderr, "\n----------Pestrie Profile------------\n" );
   show_res_use( "PesTrie indexing" );
 
-  int m = this->m;
-  int half_m = m / 2;
+  int cm = this->cm;
+  int half_m = cm / 2;
   int vn = this->vn;
   int *es_size = this->es_size;
   int *lastV = this->lastV;
-  vector<CrossEdgeRep*> *cross_edges = this->cross_edges;
   int n_cross = 0;
 
   // Equivalent sets for stores
@@ -122,22 +103,22 @@ PesTrieDual::basic_profile_pestrie()
     int sz = es_size[i];
     // Some root nodes contain only the objects 
     if ( sz == 1 ) n_es_stores--;
-    n_cross += cross_edges[i].size();
+    n_cross += n_cross_edges( i );
   }
 
   // Equivalent sets for loads
-  int n_es_loads = lastV[m-1] - lastV[half_m-1];
-  for ( int i = half_m; i < m; ++i ) {
+  int n_es_loads = lastV[cm-1] - lastV[half_m-1];
+  for ( int i = half_m; i < cm; ++i ) {
     int sz = es_size[i];
     // Some root nodes contain only the objects 
     if ( sz == 1 ) n_es_loads--;
-    n_cross += cross_edges[i].size();
+    n_cross += n_cross_edges( i );
   }
   
   fprintf( stderr, "PesTrie : Trees = %d, Nodes = %d, Edges (Cross Edges) = %d (%d)\n",
-	   m,
+	   cm,
 	   vn, 
-	   n_cross + vn - m, n_cross );
+	   n_cross + vn - cm, n_cross );
 
   fprintf( stderr, "PesTrie : ES of stores = %d, ES of loads = %d\n",
 	   n_es_stores, n_es_loads );
@@ -147,31 +128,31 @@ PesTrieDual::basic_profile_pestrie()
 /*
  * We pair up the cross edges from the two halves of the input PesTrie.
  * Then, for every root r in the first half with corresponding r' in the second half, we pair up their cross edges.  
+ * The two trees of an object are always owned by the same worker.
  */
 int 
-PesTrieDual::build_index()
+PesTrieDual::pair_up_trees( int tid, SegTree* seg_tree )
 {
   int i, j, k;
   struct Rectangle r, rr;
   struct CrossEdgeRep *p, *q;
 
   // We first retrieve the PesTrie information
-  int m = this->m;
-  int half_m = m / 2;
-  vector<int> *tree_edges = this->tree_edges;
-  vector<CrossEdgeRep*> *cross_edges = this->cross_edges;
+  int cm = this->cm;
+  int half_m = cm / 2;
+  int *tree_start = this->tree_start;
+  int *tree_edges = this->tree_edges;
+  vector<CrossEdgeRep> buf_a, buf_b;
   int *pes = this->pes;
   int *preV = this->preV;
   int *lastV = this->lastV;
   
-  // Then, the auxiliary data structures
-  SegTree* seg_tree = build_segtree( 0, this->vn );
-
   // For statistics use
   int n_gen_rects = 0;
 
   // We iteratively insert all rectangles
   for ( k = 0; k < half_m; ++k ) {
+    if ( !own_tree( tid, k ) ) continue;
     int trA = k;
     int trB = k + half_m;
     
@@ -184,25 +165,26 @@ PesTrieDual::build_index()
       continue;
     */
 
+    CrossEdgeRep *edgesA = fetch_cross_edges( trA, buf_a );
+    CrossEdgeRep *edgesB = fetch_cross_edges( trB, buf_b );
+    int size1 = n_cross_edges( trA );
+    int size2 = n_cross_edges( trB );
+
     // We first update the \xi conditions of all the cross edges of trA and trB
-    int trees[] = {trA, trB};
+    CrossEdgeRep *edges[] = {edgesA, edgesB};
+    int sizes[] = {size1, size2};
     for ( i = 0; i < 2; ++i ) {
-      int tr = trees[i];
-      for ( vector<CrossEdgeRep*>::iterator it = cross_edges[tr].begin(),
-	      ie = cross_edges[tr].end(); it != ie; ++it ) {
-	p = *it;
-	if ( p -> start == tree_edges[p->t].size() ) {
+      for ( p = edges[i], q = edges[i] + sizes[i]; p < q; ++p ) {
+	j = tree_start[ p->t ] + p->start;
+	if ( j == tree_start[ p->t + 1 ] ) {
 	  // In this case, we cannot walk down from p->t
 	  p->start = preV[p->t];
 	}
 	else 
-	  p->start = lastV[ tree_edges[p->t][p->start] ];
+	  p->start = lastV[ tree_edges[j] ];
       }
     }
 
-    int size1 = cross_edges[trA].size();
-    int size2 = cross_edges[trB].size();
- 
     // We generate the store-load conflicts
     for ( i = -1; i < size1; ++i ) {
       if ( i == -1 ) {
@@ -211,7 +193,7 @@ PesTrieDual::build_index()
 	r.x2 = lastV[trA];
       }
       else {
-	p = cross_edges[trA][i];
+	p = edgesA + i;
 	r.x1 = preV[ p->t ];
 	r.x2 = p->start;
       }
@@ -224,7 +206,7 @@ PesTrieDual::build_index()
 	  r.y2 = lastV[trB];
 	}
 	else {
-	  p = cross_edges[trB][j];
+	  p = edgesB + j;
 	  r.y1 = preV[ p->t ];
 	  r.y2 = p->start;
 	}
@@ -238,9 +220,8 @@ PesTrieDual::build_index()
     }
     
     // Then we generate the store store conflicts
-    for ( vector<CrossEdgeRep*>::iterator it1 = cross_edges[trA].begin(),
-	    ie = cross_edges[trA].end(); it1 != ie; ++it1 ) {
-      p = *it1;
+    for ( CrossEdgeRep *it1 = edgesA, *ie = edgesA + size1; it1 != ie; ++it1 ) {
+      p = it1;
       int targetT1 = pes[p->t];
 
       // We fill two templates
@@ -256,8 +237,8 @@ PesTrieDual::build_index()
       ++n_gen_rects;
 
       // case-2
-      for ( vector<CrossEdgeRep*>::iterator it2 = it1 + 1; it2 != ie; ++it2 ) {
-	p = *it2;
+      for ( CrossEdgeRep *it2 = it1 + 1; it2 != ie; ++it2 ) {
+	p = it2;
 	int targetT2 = pes[p->t];
 	if ( targetT1 == targetT2 ) continue;
 	
@@ -281,9 +262,7 @@ PesTrieDual::build_index()
     }
   }
 
-  this->seg_tree = seg_tree;
-  this->n_gen_rects = n_gen_rects;
-  return 0;
+  return n_gen_rects;
 }
 
 /*
@@ -299,54 +278,68 @@ PesTrieDual::build_index()
  * 2. The next m rows correspond to Or.
  */
 PesTrie* 
-dual_parse_input( FILE* fp, const PesOpts* pes_opts )
+dual_parse_input( MatrixReader* reader, const PesOpts* pes_opts )
 {
   int i, k;
-  int n, m;
   int nl, ns;
-  int type, dst;
+  int type;
+  const int *cols;
   
   // n is the number of pointers, m is the number of objects
-  fscanf( fp, "%d %d", &n, &m );
+  int n = reader->n;
+  int m = reader->m;
   PesTrie* pestrie = new PesTrieDual( n, m + m, pes_opts );
 
   // Auxiliary data structures
   int *r_count = new int[n];
-  memset( r_count, 0, sizeof(int) * n );
-  
-  /*
-   * Format 0: every line is leaded by a number indicating the number of integers in this row.
-   * Format 1: every line is ended by -1
-   */
-  int input_format = pes_opts->input_format;
+  pestrie->r_count = r_count;
   nl = ns = 0;
 
-  for ( i = 0; i < n; ++i ) {
-    // the mod/ref flag
-    fscanf( fp, "%d", &type );
-    if ( type == SE_STORE ) ++ns;
-    else ++nl;
-
-    if ( input_format == INPUT_START_BY_SIZE ) {
-      fscanf( fp, "%d", &k );
-      r_count[i] = k;
+  ParsedMatrix *pm = NULL;
+  if ( pes_opts->low_memory ) {
+    // The transpose is sorted on the disk
+    pestrie->disk_T = transpose_to_disk( reader, m + m, m, pes_opts->mem_budget / 2, r_count, &nl );
+    if ( pestrie->disk_T == NULL ) {
+      delete pestrie;
+      return NULL;
+    }
+    ns = n - nl;
+  }
+  else if ( pes_opts->n_threads > 1 )
+    pm = reader->parse_in_parallel( pes_opts->n_threads, true );
+
+  if ( pm != NULL ) {
+    // The rows are decoded in parallel, we merge them column by column
+    for ( i = 0; i < n; ++i ) {
+      if ( pm->row_types[i] == SE_STORE ) ++ns;
+      else ++nl;
     }
-    else
-      // set a large value to k
-      k = INT_MAX;
-    
-    while ( k > 0 ) {
-      fscanf( fp, "%d", &dst );
-      if ( dst == -1 ) break;
 
-      k--;
+    memcpy( r_count, pm->row_lens, sizeof(int) * n );
+    pestrie->mat_T = transpose_to_csr( pm, m + m, m );
+    delete pm;
+  }
+  else if ( pestrie->disk_T == NULL ) {
+    CsrTransposer facts( n, m + m );
+    
+    for ( i = 0; i < n; ++i ) {
+      k = reader->next_row( &type, &cols );
+      if ( k == -1 ) {
+	delete pestrie;
+	return NULL;
+      }
+      
+      // the mod/ref flag
+      if ( type == SE_STORE ) ++ns;
+      else ++nl;
+      
+      r_count[i] = k;
       // We distinguish the same memory location via the MOD/REF flag
-      if ( type == SE_LOAD ) dst += m;
-      pestrie->write_bit( i, dst );
+      facts.append_row( cols, k, type == SE_LOAD ? m : 0 );
     }
 
-    if ( input_format == INPUT_END_BY_MINUS_ONE )
-      r_count[i] = INT_MAX - k;
+    // The matrix is frozen and transposed at once
+    pestrie->mat_T = facts.transpose();
   }
 
   // Output statistics
@@ -356,6 +349,5 @@ dual_parse_input( FILE* fp, const PesOpts* pes_opts )
 
   // We set up the processing functions
   pestrie->index_type = SE_MATRIX;
-  pestrie->r_count = r_count;
   return pestrie;
 }
@@ -12,9 +12,11 @@
 #include <cstdio>
 #include <unistd.h>
 #include <cstdlib>
+#include <cstring>
 #include "constants.hh"
 #include "pestrie.hh"
 #include "profile_helper.h"
+#include "matrix-io.hh"
 #include "segtree.hh"
 
 using namespace std;
@@ -23,6 +25,7 @@ static bool interactive_query = false;
 static int input_format = 0;
 static char *input_file = NULL;
 static char *output_file = NULL; 
+static char *delta_file = NULL;
 static int matrix_type = 0;
 static const char* magic_numbers[] = { PESTRIE_PT_1, PESTRIE_SE_1 };
 
@@ -39,16 +42,28 @@ print_help(const char* prog_name)
   printf( "       0 : Sort by size;\n" );
   printf( "       1 : Sort by hub degrees (default);\n" );
   printf( "       2 : Random;\n" );
+  printf( "       3 : Greedily pick the object that adds the fewest cross edges;\n" );
+  printf( "       4 : Predict the index of 0, 1 and 3 by a dry run, and use the smallest;\n" );
   printf( "-e [num] : Specify the format of the input matrix\n" );
   printf( "       0 : Points-to matrix (default);\n" );
   printf( "       1 : Side-effect matrix.\n" );
   printf( "-g       : Give the details of pestrie (default = false).\n" );
   printf( "-i       : interactive query.\n" );
   printf( "-m       : Disable indistinguishable objects merging.\n" );
+  printf( "-o [file]: Save the order of the objects to the file.\n" );
+  printf( "-r [file]: Start from the order saved by -o, only the new objects are weighed and slotted in.\n" );
+  printf( "-U [file]: Update the index built for input_file to the facts appended by -D, only the figures of the trees touched by the new facts are regenerated.\n" );
+  printf( "-D [file]: The appended facts as an edge list (-F 3), the header gives the sizes of the updated matrix.\n" );
+  printf( "-L       : Low-memory build, the transposed matrix and the cross edges are kept in temporary files, the other structures take O(#pointers + #objects) memory besides the -M budget (no -p or -b 3/4).\n" );
+  printf( "-p       : Collapse the pointers with the same points-to sets before building Pes-Trie.\n" );
   printf( "-F       : Specify the format of the input file\n" );
   printf( "       0 : Each line starts with the number of the following elements (default);\n" );
-  printf( "       1 : Each line ends with -1.\n" );
+  printf( "       1 : Each line ends with -1;\n" );
+  printf( "       3 : Unsorted edge list, one (pointer, object) pair per line.\n" );
+  printf( "-M [num] : Sort the edge list with num MB memory, then spill to the disk (default = %d).\n", DEFAULT_MEM_BUDGET_MB );
   printf( "-l       : The input points-to information is produced by LLVM.\n" );
+  printf( "-t [num] : Use num worker threads (default = 1).\n" );
+  printf( "The input_file can be - for reading the matrix from the standard input.\n" );
 }
 
 static PesOpts* 
@@ -58,7 +73,7 @@ parse_options( int argc, char **argv )
 
   PesOpts* pes_opts = new PesOpts();
   
-  while ( (c = getopt( argc, argv, "b:de:F:ighml" ) ) != -1 ) {
+  while ( (c = getopt( argc, argv, "b:de:F:ighmplt:M:o:r:U:D:L" ) ) != -1 ) {
     switch ( c ) {
     case 'b':
       pes_opts->permute_way = atoi( optarg );
@@ -84,6 +99,15 @@ parse_options( int argc, char **argv )
       pes_opts->input_format = atoi( optarg );
       break;
 
+    case 't':
+      pes_opts->n_threads = atoi( optarg );
+      if ( pes_opts->n_threads < 1 ) pes_opts->n_threads = 1;
+      break;
+
+    case 'M':
+      pes_opts->mem_budget = atol( optarg ) << 20;
+      break;
+
     case 'd':
       pes_opts->pestrie_draw = true;
       break;
@@ -92,6 +116,30 @@ parse_options( int argc, char **argv )
       pes_opts->obj_merge = false;
       break;
 
+    case 'p':
+      pes_opts->ptr_merge = true;
+      break;
+
+    case 'o':
+      pes_opts->order_out = optarg;
+      break;
+
+    case 'r':
+      pes_opts->order_in = optarg;
+      break;
+
+    case 'U':
+      pes_opts->prior_index = optarg;
+      break;
+
+    case 'D':
+      delta_file = optarg;
+      break;
+
+    case 'L':
+      pes_opts->low_memory = true;
+      break;
+
     case 'h':
       print_help(argv[0]);
       delete pes_opts;
@@ -117,6 +165,33 @@ parse_options( int argc, char **argv )
     return NULL;
   }  
 
+  if ( ( pes_opts->prior_index == NULL ) != ( delta_file == NULL ) ) {
+    printf( "The update mode needs both the prior index (-U) and the appended facts (-D).\n" );
+    delete pes_opts;
+    return NULL;
+  }
+
+  if ( delta_file != NULL && pes_opts->low_memory ) {
+    printf( "The update mode cannot be combined with the low-memory build.\n" );
+    delete pes_opts;
+    return NULL;
+  }
+
+  if ( pes_opts->low_memory &&
+       ( pes_opts->ptr_merge ||
+	 pes_opts->permute_way == SORT_BY_CROSS_EDGES ||
+	 pes_opts->permute_way == SORT_BY_DRY_RUN ) ) {
+    printf( "The low-memory build cannot collapse the pointers (-p) or simulate the orders (-b 3/4).\n" );
+    delete pes_opts;
+    return NULL;
+  }
+
+  if ( delta_file != NULL && matrix_type != PT_MATRIX ) {
+    printf( "The update mode only supports points-to matrix.\n" );
+    delete pes_opts;
+    return NULL;
+  }
+
   input_file = argv[optind];
   output_file = NULL;
   
@@ -125,27 +200,76 @@ parse_options( int argc, char **argv )
     output_file = argv[optind];
   }
 
+  if ( interactive_query && strcmp( input_file, "-" ) == 0 ) {
+    printf( "The interactive query needs the standard input, please give an input file.\n" );
+    delete pes_opts;
+    return NULL;
+  }
+
   return pes_opts;
 }
 
+// Read the whole input and append the facts of the delta file
+static MatrixSnapshot*
+append_delta( MatrixReader* reader, char** dirty_ptrs, char** dirty_objs, const PesOpts* pes_opts )
+{
+  MatrixSnapshot *base = take_snapshot( reader );
+  if ( base == NULL ) return NULL;
+
+  MatrixReader *delta = open_matrix_reader( delta_file, matrix_type, INPUT_EDGE_LIST, pes_opts->mem_budget );
+  if ( delta == NULL ) {
+    fprintf( stderr, "Cannot read the appended facts: %s\n", delta_file );
+    delete base;
+    return NULL;
+  }
+
+  MatrixSnapshot *snap = append_facts( base, delta, dirty_ptrs, dirty_objs );
+  if ( snap != NULL )
+    fprintf( stderr, "Appended facts : %ld, Pointers = %d -> %d, Objects = %d -> %d\n",
+	     snap->offs[snap->n] - base->offs[base->n], base->n, snap->n, base->m, snap->m );
+
+  delete delta;
+  delete base;
+  return snap;
+}
+
 // Read the input points-to/side-effect matrix
 // We directly reverse it to obtain the pointed-to/moded-used by matrix
 PesTrie* input_matrix( const PesOpts* pes_opts )
 {
-  FILE *fp;
+  MatrixReader *reader;
 
-  fp = fopen( input_file, "r" );
-  if ( fp == NULL ) return NULL;
+  reader = open_matrix_reader( input_file, matrix_type, pes_opts->input_format, pes_opts->mem_budget );
+  if ( reader == NULL ) return NULL;
   fprintf( stderr, "\n---------Input: %s---------\n", input_file );
 
+  // In the update mode, the appended facts are merged into the input
+  MatrixSnapshot *snap = NULL;
+  char *dirty_ptrs = NULL, *dirty_objs = NULL;
+  if ( delta_file != NULL ) {
+    snap = append_delta( reader, &dirty_ptrs, &dirty_objs, pes_opts );
+    delete reader;
+    if ( snap == NULL ) return NULL;
+    reader = snap->open_reader();
+  }
+
   PesTrie* pestrie = NULL;
 
   if ( matrix_type == PT_MATRIX )
-    pestrie = self_parse_input(fp, pes_opts);
+    pestrie = self_parse_input(reader, pes_opts);
   else
-    pestrie = dual_parse_input(fp, pes_opts);
+    pestrie = dual_parse_input(reader, pes_opts);
 
-  fclose( fp );    
+  delete reader;
+  if ( snap != NULL ) delete snap;
+  if ( pestrie != NULL ) {
+    pestrie->dirty_ptrs = dirty_ptrs;
+    pestrie->dirty_objs = dirty_objs;
+  }
+  else if ( dirty_objs != NULL ) {
+    delete[] dirty_ptrs;
+    delete[] dirty_objs;
+  }
 
   show_res_use( "Input" );
 
@@ -160,7 +284,6 @@ execute_query( PesTrie *pestrie )
   int x, y;
   
   SegTree *seg_tree = pestrie->seg_tree;
-  int *bl = pestrie->bl;
   int *pes = pestrie->pes;
   int *preV = pestrie->preV;
 
@@ -173,8 +296,8 @@ execute_query( PesTrie *pestrie )
     scanf( "%d %d", &x, &y );
     if ( x == -1 ) break;
 
-    x = bl[x];
-    y = bl[y];
+    x = pestrie->get_es( x );
+    y = pestrie->get_es( y );
     int ans = false;
     if ( x != -1 && y != -1 ) {
       if ( pes[x] == pes[y] )
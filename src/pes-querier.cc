@@ -364,6 +364,11 @@ public:
   int ListModRefVars( int x, IFilter* filter );
   int ListConflicts( int x, IFilter* filter );
 
+public:
+  bool RemovePointer( int x );
+  bool RemoveObject( int o );
+  int Compact( int max_sets );
+
 public:
   int getPtrEqID(int x) { return preV[x]; }
   int getObjEqID(int x) { return preV[x+n]; }
@@ -385,6 +390,8 @@ public:
     es2ptrs = new VECTOR(int)[n_vertex];
     qtree = new SegTree(n_vertex);
     es2objs = NULL;
+    n_retired = new int[n_vertex];
+    memset( n_retired, 0, sizeof(int) * n_vertex );
 
     if ( type == PT_MATRIX ) {
       es2objs = new VECTOR(int)[n_vertex];
@@ -400,6 +407,7 @@ public:
     if ( root_tree != NULL ) delete[] root_tree;
     if ( es2ptrs != NULL ) delete[] es2ptrs;
     if ( es2objs != NULL ) delete[] es2objs;
+    if ( n_retired != NULL ) delete[] n_retired;
   }
   
 public:
@@ -408,6 +416,8 @@ public:
 private:
   void rebuild_mapping_info( FILE* );
   void extract_pointsto(SegNode*);
+  void compact_es( int v );
+  int iterate_live_set( VECTOR(int) *es2set, int v, IFilter* filter );
 
 private:
   SegTree* qtree;
@@ -417,6 +427,7 @@ private:
   // The number of pointers, objects, trees, and nodes
   int n, m, n_trees, vertex_num;
   // Mapping from pointer and object to tree ID
+  // A retired pointer/object is also marked by -1, the same as the one pointing to nothing
   int *tree;
   // Mapping from pointer and object to pre-order stamp
   int *preV;
@@ -426,6 +437,10 @@ private:
   int *root_tree;
   // Mapping from equivalent set to pointers/objects
   VECTOR(int) *es2ptrs, *es2objs;
+  // #retired members still listed in es2ptrs/es2objs for every ES
+  int *n_retired;
+  // The ESes that have retired members, some of them may be compacted by the queries already
+  VECTOR(int) dirty_es;
   // Points-to or side-effect information
   int index_type;
   // Merging the aliasing information bottom up on demand
@@ -465,13 +480,16 @@ PesQS::rebuild_mapping_info( FILE* fp )
     int v = preV[n+i];
     if ( v != -1 ) {
       int tr = root_tree[v];
-      es2objs[v].push_back(i);
+      // Only the points-to index lists the objects
+      if ( es2objs != NULL ) es2objs[v].push_back(i);
       tree[i+n] = tr;
     }
+    else
+      tree[i+n] = -1;
   }
 
   if ( index_type == SE_MATRIX ) 
-    max_store_prev = root_prevs[m/2];
+    max_store_prev = root_prevs[n_trees/2];
 
   // We re-discover the tree codes for pointers through the binary search
   // Sentinels
@@ -714,6 +732,78 @@ PesQS::extract_pointsto( SegNode* p )
   p->pt_extracted = true;
 }
 
+/*
+ * The removals are O(1), the retired members are only filtered out of the ESes later.
+ * An ES is compacted by the first list query that walks it, or by Compact.
+ * Note that retiring an object does not change the aliases of the pointers that point to it.
+ */
+bool
+PesQS::RemovePointer( int x )
+{
+  if ( x < 0 || x >= n || tree[x] == -1 ) return false;
+
+  int v = preV[x];
+  tree[x] = -1;
+  if ( n_retired[v]++ == 0 ) dirty_es.push_back(v);
+  return true;
+}
+
+bool
+PesQS::RemoveObject( int o )
+{
+  if ( o < 0 || o >= m || tree[o+n] == -1 ) return false;
+
+  int v = preV[o+n];
+  tree[o+n] = -1;
+  // Only the points-to index lists the objects
+  if ( es2objs != NULL && n_retired[v]++ == 0 ) dirty_es.push_back(v);
+  return true;
+}
+
+// Drop the retired members of ES v
+void
+PesQS::compact_es( int v )
+{
+  VECTOR(int) *sets[] = { es2ptrs + v, es2objs == NULL ? NULL : es2objs + v };
+  int base[] = { 0, n };
+
+  for ( int i = 0; i < 2; ++i ) {
+    if ( sets[i] == NULL ) continue;
+    VECTOR(int) &es_set = *sets[i];
+    int size = es_set.size();
+    int k = 0;
+
+    for ( int j = 0; j < size; ++j ) {
+      int q = es_set[j];
+      if ( tree[q + base[i]] != -1 ) es_set[k++] = q;
+    }
+    es_set.reset_end(k);
+  }
+
+  n_retired[v] = 0;
+}
+
+int
+PesQS::iterate_live_set( VECTOR(int) *es2set, int v, IFilter* filter )
+{
+  if ( n_retired[v] > 0 ) compact_es( v );
+  return iterate_equivalent_set( es2set[v], filter );
+}
+
+int
+PesQS::Compact( int max_sets )
+{
+  while ( dirty_es.size() > 0 && max_sets > 0 ) {
+    int v = dirty_es.pop_back();
+    // Skip the ESes compacted by the queries
+    if ( n_retired[v] == 0 ) continue;
+    compact_es( v );
+    --max_sets;
+  }
+
+  return dirty_es.size();
+}
+
 // List query in real use should be passed in a handler.
 // That handler decide what to do with the query answer.
 int 
@@ -723,7 +813,7 @@ PesQS::ListPointsTo( int x, IFilter* filter )
   if ( tr == -1 ) return 0;
   
   // Don't forget x points-to tree[x]
-  int ans = iterate_equivalent_set( es2objs[root_prevs[tr]], filter );
+  int ans = iterate_live_set( es2objs, root_prevs[tr], filter );
   
   x = preV[x];
   SegNode* p = qtree->get_unit_node(x);
@@ -737,7 +827,7 @@ PesQS::ListPointsTo( int x, IFilter* filter )
     int size = pointsto.size();
     for ( int i = 0; i < size; ++i ) {
       int o = pointsto[i];
-      ans += iterate_equivalent_set( es2objs[o], filter );	
+      ans += iterate_live_set( es2objs, o, filter );
     }
     p = p->parent;
   }
@@ -758,7 +848,7 @@ PesQS::ListAliases( int x, IFilter* filter )
   {
     int upper = root_prevs[tr+1];
     for ( int i = root_prevs[tr]; i < upper; ++i ) {
-      ans += iterate_equivalent_set( es2ptrs[i], filter );
+      ans += iterate_live_set( es2ptrs, i, filter );
     }
   }
 
@@ -774,7 +864,7 @@ PesQS::ListAliases( int x, IFilter* filter )
       int lower = r->y1;
       int upper = r->y2;
       do {
-	ans += iterate_equivalent_set( es2ptrs[lower], filter );	
+	ans += iterate_live_set( es2ptrs, lower, filter );
 	++lower;
       } while ( lower <= upper );			
     }
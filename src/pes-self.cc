@@ -11,7 +11,6 @@
 #include <cstdio>
 #include <cstring>
 #include <algorithm>
-#include <climits>
 #include "pestrie.hh"
 #include "profile_helper.h"
 
@@ -22,40 +21,29 @@ void
 PesTrieSelf::self_permute_rows()
 {
   int i, k;
-  unsigned x;
-  bitmap_iterator bi;
 
   // Read the address of the data structures
   //int n = pestrie->n;
   int cm = this->cm;
-  bitmap* mat_T = this->mat_T;
   MatrixRow* r_order = this->r_order;
-  int *r_count = this->r_count;
   
   int permute_way = this->pes_opts->permute_way;
 
-  if ( permute_way != SORT_BY_RANDOM ) {
-    if ( permute_way == SORT_BY_HUB_DEGREE ) {      
-      for ( i = 0; i < cm; ++i ) {
-	long wt = 0;
-	EXECUTE_IF_SET_IN_BITMAP( mat_T[i], 0, x, bi ) {
-	  // We square the points-to size of x
-	  long c = r_count[x];
-	  wt += c * c;
-	}
-	
-	r_order[i].wt = wt;
-      }
-    }
-    else if ( permute_way == SORT_BY_SIZE ) {
-      for ( i = 0; i < cm; ++i ) {
-	// number of elements for each row in the input matrix
-	r_order[i].wt = bitmap_count_bits( mat_T[i] );
-      }
-    }
-    
+  if ( this->prior != NULL ) {
+    // The unchanged components must keep the order of the prior index
+    load_prior_order( cm, permute_way );
+  }
+  else if ( this->pes_opts->order_in != NULL &&
+	    load_order( this->pes_opts->order_in, cm, 0, permute_way ) ) {
+    // The order of a prior run is reused, see load_order
+  }
+  else if ( permute_way == SORT_BY_DRY_RUN )
+    dry_run_orders( cm, 0 );
+  else if ( permute_way == SORT_BY_CROSS_EDGES )
+    order_by_cross_edges( r_order, cm, 0, NULL );
+  else if ( permute_way != SORT_BY_RANDOM ) {
     // Sort the rows of the input matrix by the weights from largest to smallest
-    stable_sort( r_order, r_order + cm );
+    weigh_and_sort_rows( r_order, cm, 0, permute_way );
   }
   else {
     //random order
@@ -86,7 +74,6 @@ PesTrieSelf::basic_profile_pestrie()
   int vn = this->vn;
   int *es_size = this->es_size;
   int *pes = this->pes;
-  vector<CrossEdgeRep*> *cross_edges = this->cross_edges;
 
   // We count the number of equivalent sets
   int n_es_pointers = this->vn;
@@ -95,7 +82,7 @@ PesTrieSelf::basic_profile_pestrie()
     int sz = es_size[i];
     // Some root nodes contain only the objects 
     if ( sz == 1 ) n_es_pointers--;
-    n_cross += cross_edges[i].size();
+    n_cross += n_cross_edges( i );
   }
   
   fprintf( stderr, "PesTrie : Trees = %d, Nodes (Contain Pointers) = %d (%d), Edges (Cross Edges) = %d (%d)\n",
@@ -106,10 +93,10 @@ PesTrieSelf::basic_profile_pestrie()
 
 /*
  * We pair up the cross edges to generate the index rectangles.
- * We store the index figures in the segment tree.
+ * We store the index figures in the segment tree of worker tid.
  */
 int 
-PesTrieSelf::build_index()
+PesTrieSelf::pair_up_trees( int tid, SegTree* seg_tree )
 {
   int i, j, k;
   int sPrev, tr, tail;
@@ -119,18 +106,20 @@ PesTrieSelf::build_index()
   // We first obtain the pestrie information
   //int m = this->m;
   int cm = this->cm;
-  int vn = this->vn;
   int *pes = this->pes;
   int *preV = this->preV;
   int *lastV = this->lastV;
-  vector<int> *tree_edges = this->tree_edges;
-  vector<CrossEdgeRep*> *cross_edges = this->cross_edges;
+  int *tree_start = this->tree_start;
+  int *tree_edges = this->tree_edges;
+  vector<CrossEdgeRep> buf;
+
+  // In the update mode, the figures between two kept trees are copied from the prior index
+  const char *kept = ( this->prior == NULL ? NULL : this->prior->kept );
 
   // Then, the auxiliary data structures
   int *vis = new int[cm];
   int *Queue = new int[cm];
   CrossEdgeRep **groups = new CrossEdgeRep*[cm];   // Help classify the cross edges of the same root
-  SegTree* seg_tree = build_segtree( 0, vn );
   
   memset( groups, 0, sizeof(void*) * cm );
   memset( vis, 0, sizeof(int) * cm );
@@ -140,8 +129,9 @@ PesTrieSelf::build_index()
 
   // We iteratively insert all rectangles
   for ( k = 1; k < cm; ++k ) {
-    vector<CrossEdgeRep*> &treeK = cross_edges[k];
-    int size = treeK.size();
+    if ( !own_tree( tid, k ) ) continue;
+    CrossEdgeRep *treeK = fetch_cross_edges( k, buf );
+    int size = n_cross_edges( k );
 
     // Pair up the cross pointers and local pointers
     r.y1 = preV[k];
@@ -149,21 +139,23 @@ PesTrieSelf::build_index()
     tail = 0;
 
     for ( i = 0; i < size; ++i ) {
-      p = treeK[i];
+      p = treeK + i;
       sPrev = preV[ p->t ];
       r.x1 = sPrev;
-      if ( p -> start == tree_edges[p->t].size() ) {
+      j = tree_start[ p->t ] + p->start;
+      if ( j == tree_start[ p->t + 1 ] ) {
 	// In this case, we cannot walk down from p->t
 	// We directly set p->start to be the pre-order of p->t 
 	p -> start = sPrev;
       }
       else {
-	p -> start = lastV[ tree_edges[p->t][p->start] ];
+	p -> start = lastV[ tree_edges[j] ];
       }
       r.x2 = p->start;
-      seg_tree->insert_segtree(r);
-      
-      ++n_gen_rects;
+      if ( kept == NULL || kept[k] == 0 || kept[ pes[p->t] ] == 0 ) {
+	seg_tree->insert_segtree(r);
+	++n_gen_rects;
+      }
 
       // Group the cross edges according to their tree values
       // Here, vis is used to mark if a particular tree has been visited
@@ -203,6 +195,7 @@ PesTrieSelf::build_index()
 	  r.x1 = preV[ p->t ];
 	  r.x2 = p->start;
 	  for ( j = i + 1; j < tail; ++j ) {
+	    if ( kept != NULL && kept[tr] && kept[ Queue[j] ] ) continue;
 	    q = groups[ Queue[j] ];
 	    while ( q != NULL ) {
 	      r.y1 = preV[ q->t ];
@@ -221,15 +214,11 @@ PesTrieSelf::build_index()
     }
   }
   
-  // Assign back
-  this->seg_tree = seg_tree;
-  this->n_gen_rects = n_gen_rects;
-  
   delete[] groups;
   delete[] Queue;
   delete[] vis;
 
-  return 0;
+  return n_gen_rects;
 }
 
 /*
@@ -237,45 +226,68 @@ PesTrieSelf::build_index()
  * Therefore, parsing input should be specific to different matrices.
  */
 PesTrie* 
-self_parse_input( FILE* fp, const PesOpts* pes_opts )
+self_parse_input( MatrixReader* reader, const PesOpts* pes_opts )
 {
   int i, k;
-  int n, m;
-  int dst;
+  const int *cols;
   
   // n is the number of pointers, m is the number of objects
-  fscanf( fp, "%d %d", &n, &m );
+  int n = reader->n;
+  int m = reader->m;
   PesTrie* pestrie = new PesTrieSelf( n, m, pes_opts );
 
   // Auxiliary data structures
   int *r_count = new int[n];
-  memset( r_count, 0, sizeof(int) * n );
+  pestrie->r_count = r_count;
 
-  /*
-   * Format 0: every line is leaded by a number indicating the number of integers in this row.
-   * Format 1: every line is ended by -1
-   */
-  int input_format = pes_opts->input_format;
+  ParsedMatrix *pm = NULL;
+  if ( pes_opts->low_memory ) {
+    // The transpose is sorted on the disk, the equivalent objects are merged by merge_equivalent_rows
+    pestrie->disk_T = transpose_to_disk( reader, m, 0, pes_opts->mem_budget / 2, r_count, NULL );
+    if ( pestrie->disk_T == NULL ) {
+      delete pestrie;
+      return NULL;
+    }
+  }
+  else if ( pes_opts->n_threads > 1 )
+    pm = reader->parse_in_parallel( pes_opts->n_threads, true );
 
-  for ( i = 0; i < n; ++i ) {
-    if ( input_format == INPUT_START_BY_SIZE ) {
-      fscanf( fp, "%d", &k );
-      r_count[i] = k;
+  if ( pm != NULL ) {
+    // The rows are decoded in parallel, we merge them column by column
+    memcpy( r_count, pm->row_lens, sizeof(int) * n );
+    if ( pes_opts->obj_merge ) {
+      pestrie->m_rep = new int[m];
+      pestrie->mat_T = transpose_distinct_to_csr( pm, m, pestrie->m_rep );
+      pestrie->cm = pestrie->mat_T->n;
     }
     else
-      // set a large value to k
-      k = INT_MAX;
+      pestrie->mat_T = transpose_to_csr( pm, m, 0 );
+    delete pm;
+  }
+  else if ( pestrie->disk_T == NULL ) {
+    // The equivalent objects are merged on the fly
+    bool merging = pes_opts->obj_merge;
+    CsrTransposer facts( n, m, merging );
     
-    while ( k > 0 ) {
-      fscanf( fp, "%d", &dst );
-      if ( dst == -1 ) break;
-           
-      k--;
-      pestrie->write_bit( i, dst );
+    for ( i = 0; i < n; ++i ) {
+      k = reader->next_row( NULL, &cols );
+      if ( k == -1 ) {
+	delete pestrie;
+	return NULL;
+      }
+      
+      r_count[i] = k;
+      facts.append_row( cols, k );
     }
-    
-    if ( input_format == INPUT_END_BY_MINUS_ONE )
-      r_count[i] = INT_MAX - k;
+
+    // The matrix is frozen and transposed at once
+    if ( merging ) {
+      pestrie->m_rep = new int[m];
+      pestrie->mat_T = facts.transpose_distinct( pestrie->m_rep );
+      pestrie->cm = pestrie->mat_T->n;
+    }
+    else
+      pestrie->mat_T = facts.transpose();
   }
 
   // Output statistics
@@ -285,6 +297,5 @@ self_parse_input( FILE* fp, const PesOpts* pes_opts )
 
   // We set up the processing functions
   pestrie->index_type = PT_MATRIX;
-  pestrie->r_count = r_count;
   return pestrie;
 }
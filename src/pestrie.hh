@@ -18,6 +18,7 @@
 #include "bitmap.h"
 #include "segtree.hh"
 #include "constants.hh"
+#include "matrix-io.hh"
 #include <vector>
 
 struct PesOpts 
@@ -28,12 +29,24 @@ struct PesOpts
   int permute_way;
   // Merge the indistinguishable objects?
   bool obj_merge;
+  // Collapse the pointers with the same points-to sets before building PesTrie?
+  bool ptr_merge;
   // Profiling PesTrie or not
   bool profile_in_detail;
   // Output graphviz format for PesTrie visualization
   bool pestrie_draw;
   //
   bool llvm_input;
+  // #worker threads
+  int n_threads;
+  // #bytes of memory for sorting the input
+  long mem_budget;
+  // Start the permutation from this order file, and save the final order to the other
+  const char *order_in, *order_out;
+  // Update mode, the figures of the unchanged components are copied from this index
+  const char *prior_index;
+  // Keep the transposed matrix and the cross edges on the disk, mem_budget bounds the buffers for them
+  bool low_memory;
 
   PesOpts()
   {
@@ -41,22 +54,25 @@ struct PesOpts
     input_format = INPUT_START_BY_SIZE;
     permute_way = SORT_BY_HUB_DEGREE;
     obj_merge = true;
+    ptr_merge = false;
     profile_in_detail = false;
     pestrie_draw = false;
     llvm_input = false;
+    n_threads = 1;
+    mem_budget = DEFAULT_MEM_BUDGET;
+    order_in = NULL;
+    order_out = NULL;
+    prior_index = NULL;
+    low_memory = false;
   }
 };
 
+// The cross edges live in one array, so they are neither allocated nor freed one by one
 struct CrossEdgeRep
 {
   int t;	// the other side of the edge
   int start;	// birthday
   struct CrossEdgeRep *next;
-
-  CrossEdgeRep()
-  {
-    next = NULL;
-  }
 };
 
 // Every aspects of a row of the input matrix
@@ -72,6 +88,49 @@ struct MatrixRow
 };
 
 
+// The predictions of a dry run, see PesTrie::dry_run_orders
+struct DryRun
+{
+  int vn;                    // #PesTrie nodes
+  long n_cross;              // #cross edges
+  double n_figures;          // #figures generated by build_index
+  double max_figures;        // the most figures generated by a tree
+  int max_tree;              // the row of mat_T for that tree
+};
+
+
+// An index built by a prior run for the update mode, see PesTrie::match_prior_trees
+struct PriorIndex
+{
+  int n, m, vn;
+  int *pre_aux;              // the preV labels of the pointers and objects
+  int *labels;               // the figures of unit x start from labels[unit_start[x]], leaded by their #labels
+  long *unit_start;
+  int n_trees;
+  int *roots;                // prior tree t covers the labels [roots[t], roots[t+1])
+  int *new_tree;             // the tree rebuilt for prior tree t, or -1 if it is changed
+  char *kept;                // kept[k] = 1 if the figures between tree k and the other kept trees are copied, one per new tree
+
+  PriorIndex()
+  {
+    n = m = vn = n_trees = 0;
+    pre_aux = labels = roots = new_tree = NULL;
+    unit_start = NULL;
+    kept = NULL;
+  }
+
+  ~PriorIndex()
+  {
+    if ( pre_aux != NULL ) delete[] pre_aux;
+    if ( labels != NULL ) delete[] labels;
+    if ( unit_start != NULL ) delete[] unit_start;
+    if ( roots != NULL ) delete[] roots;
+    if ( new_tree != NULL ) delete[] new_tree;
+    if ( kept != NULL ) delete[] kept;
+  }
+};
+
+
 // The base class PesTrie
 class PesTrie
 {
@@ -81,23 +140,36 @@ public:
 
   // Input matrix and its descriptions
   int n, m;                  // #rows, #columns (pt-matrix)
-  bitmap *mat_T;             // transpose of the input matrix (pted-matrix)
+  CsrMatrix *mat_T;          // transpose of the input matrix (pted-matrix)
+  DiskCsrMatrix *disk_T;     // mat_T kept on the disk in the low-memory mode, mat_T is then NULL
   MatrixRow *r_order;        // the processing order of the pted-matrix
   int *m_rep, cm;            // representatives of rows of the pted-matrix 
+  int *p_rep, cn;            // representatives of rows of the pt-matrix, PesTrie is built over the cn representatives
   int *r_count;              // #non zero columns for each row of pt-matrix
 
   // PesTrie and its descriptions
   int vn;                  // #vertex (ES)
-  std::vector<int> *tree_edges;
-  std::vector<CrossEdgeRep*> *cross_edges;
+  int *tree_start, *tree_edges; // the children of ES x are tree_edges[tree_start[x]..tree_start[x+1])
+  CrossEdgeRep *cross_edges;  // the cross edges of root k are cross_edges[cross_start[k]..cross_start[k+1])
+  long *cross_start;
+  FILE *cross_file;           // the cross edges spilled in the low-memory mode, cross_edges is then NULL
   int *bl, *pes;           // The ES label and PES label of the pointers and ESes
   int *es_size;            // #pointers for every ES
   int *preV, *lastV;       // Interval labels
 
+  // The trees of a connected component are built and paired up by the same worker
+  int n_workers;
+  int *tree_owner;           // the worker of every tree, NULL if there is only one worker
+
   // Index and descriptions
   SegTree *seg_tree;
   int n_gen_rects;
 
+  // Update mode
+  PriorIndex *prior;         // the index built before the new facts are appended
+  char *dirty_ptrs;          // the pointers that receive new facts, NULL if none
+  char *dirty_objs;          // the objects that receive new facts, NULL if none
+
   // User provided constrols
   const PesOpts* pes_opts;
 
@@ -105,63 +177,142 @@ public:
   // Initialize the necessary configurations
   PesTrie( int row, int col, const PesOpts* opts ) 
   { 
-    n = row; m = col; cm = col;
+    n = row; m = col; cm = col; cn = row;
 
-    // Allocate the matrix (the matrix is born in its transpose form)
-    mat_T = new bitmap[col];
+    // The matrix is born in its transpose form by the parser
+    mat_T = NULL;
+    disk_T = NULL;
     r_order = new MatrixRow[col];
     for ( int i = 0; i < col; ++i ) {
       r_order[i].id = i;
       r_order[i].wt = 0;
-      mat_T[i] = BITMAP_ALLOC(NULL);
     }
     
+    m_rep = NULL;
+    p_rep = NULL;
+    r_count = NULL;
+    tree_start = NULL;
     tree_edges = NULL;
     cross_edges = NULL;
+    cross_start = NULL;
+    cross_file = NULL;
     bl = NULL;
     pes = NULL;
+    es_size = NULL;
     preV = NULL;
     lastV = NULL;
     seg_tree = NULL;
+    n_workers = 1;
+    tree_owner = NULL;
+    prior = NULL;
+    dirty_ptrs = NULL;
+    dirty_objs = NULL;
     pes_opts = opts;
   }
   
-  ~PesTrie()
+  virtual ~PesTrie()
   {
-    if ( mat_T != NULL ) {
-      for ( int i = 0; i < m; ++i )
-	BITMAP_FREE( mat_T[i] );
-      delete[] mat_T;
-    }
+    if ( mat_T != NULL ) delete mat_T;
+    if ( disk_T != NULL ) delete disk_T;
 
     if ( r_order != NULL ) delete[] r_order;
+    if ( m_rep != NULL ) delete[] m_rep;
+    if ( p_rep != NULL ) delete[] p_rep;
+    if ( r_count != NULL ) delete[] r_count;
     
+    if ( tree_start != NULL ) delete[] tree_start;
     if ( tree_edges != NULL ) delete[] tree_edges;
     if ( cross_edges != NULL ) delete[] cross_edges;
+    if ( cross_start != NULL ) delete[] cross_start;
+    if ( cross_file != NULL ) fclose( cross_file );
     if ( bl != NULL ) delete[] bl;
     if ( pes != NULL ) delete[] pes;
     if ( es_size != NULL ) delete[] es_size;
     if ( preV != NULL ) delete[] preV;
     if ( lastV != NULL ) delete[] lastV;
+    if ( tree_owner != NULL ) delete[] tree_owner;
+    if ( prior != NULL ) delete prior;
+    if ( dirty_ptrs != NULL ) delete[] dirty_ptrs;
+    if ( dirty_objs != NULL ) delete[] dirty_objs;
     
     if ( seg_tree != NULL ) delete seg_tree;
     pes_opts = NULL;
   }
 
-  // The clients do not need to know the internal matrix is transposed
-  void write_bit( int r, int c )
-  {
-    bitmap_set_bit( mat_T[c], r );
-  }
-
 public:
   // Collapse the rows filled with same data for input matrix
   void merge_equivalent_rows();
 
+  // Collapse the pointers with the same points-to sets
+  void merge_equivalent_pointers();
+
+  // Weigh the first n_rows rows of the pted-matrix by permute_way and sort them from the heaviest to the lightest
+  // Row i is weighed together with row i + shift if shift > 0, rows[i].id must be i before sorting
+  void weigh_and_sort_rows( MatrixRow* rows, int n_rows, int shift, int permute_way );
+
+  // Only fill in the weights of rows[0..n_rows), their IDs can be any rows of the pted-matrix
+  void weigh_rows( MatrixRow* rows, int n_rows, int shift, int permute_way );
+
+  // Order the first n_rows rows greedily by the figures they add, or by the hub degrees if that generates fewer
+  // The same shift as above, res receives the simulation of the order if it is not NULL
+  void order_by_cross_edges( MatrixRow* rows, int n_rows, int shift, DryRun* res );
+
+  // Predict the index of every order without building it, r_order receives the best one
+  void dry_run_orders( int n_rows, int shift );
+
+  // Write the first n_rows of r_order as the input objects
+  bool save_order( const char* file_name, int n_rows );
+
+  // Start r_order from an order saved by a prior run, the new objects are weighed by permute_way
+  bool load_order( const char* file_name, int n_rows, int shift, int permute_way );
+
+  // Start r_order from the objects listed in the prior order, the same arguments as above
+  void warm_start( const int* objs, int n_listed, int n_rows, int shift, int permute_way );
+
+  // Start r_order from the tree order of the prior index
+  void load_prior_order( int n_rows, int permute_way );
+
+  // #cross edges of root k
+  int n_cross_edges( int k ) const
+  {
+    return cross_start[k+1] - cross_start[k];
+  }
+
+  // The cross edges of root k, they are read into buf if they are spilled
+  CrossEdgeRep* fetch_cross_edges( int k, std::vector<CrossEdgeRep>& buf ) const;
+
+  // The ES of pointer x, or -1 if x points to nothing
+  int get_es( int x ) const
+  {
+    if ( p_rep != NULL ) x = p_rep[x];
+    return x == -1 ? -1 : bl[x];
+  }
+
+  // Label the connected components of the trees
+  int* find_components( int* first ) const;
+
+  // Split the trees into the connected components and deal them to at most n_threads workers
+  int assign_components( int n_threads, int* w_ptrs );
+
   // Construct PesTrie from input matrix
   // This is common to both points-to and side-effect matrices
   void build_pestrie_core();
 
+  // Pair up the cross edges of every worker in its own segment tree, and merge the segment trees
+  int build_index();
+
+  // Find the trees without new facts, the figures between them are then skipped by build_index
+  void match_prior_trees();
+
+  // Copy the figures between the kept trees from the prior index
+  void reuse_prior_figures();
+
+  // Does worker tid own tree k?
+  bool own_tree( int tid, int k ) const
+  {
+    return tree_owner == NULL || tree_owner[k] == tid;
+  }
+
   void externalize_index( FILE* fp, const char* magic_number);
 
   void profile_index();
@@ -172,7 +323,8 @@ public:
   // PesTrie specialized processing functions
   // They should be implemented sub-classes
   virtual void preprocess() = 0;
-  virtual int build_index() = 0;
+  // Generate the index figures of the trees owned by worker tid, returns the #figures generated
+  virtual int pair_up_trees( int tid, SegTree* seg_tree ) = 0;
   virtual void basic_profile_pestrie() = 0;
 };
 
@@ -187,7 +339,7 @@ public:
 
 public:
   void preprocess();
-  int build_index();
+  int pair_up_trees( int tid, SegTree* seg_tree );
   void basic_profile_pestrie();
 
 private:
@@ -205,7 +357,7 @@ public:
   
 public:
   void preprocess();
-  int build_index();
+  int pair_up_trees( int tid, SegTree* seg_tree );
   void basic_profile_pestrie(); 
   
 private:
@@ -217,8 +369,8 @@ private:
 extern void init_pestrie();
 
 //
-extern PesTrie* self_parse_input( FILE*, const PesOpts* );
-extern PesTrie* dual_parse_input( FILE*, const PesOpts* );
+extern PesTrie* self_parse_input( MatrixReader*, const PesOpts* );
+extern PesTrie* dual_parse_input( MatrixReader*, const PesOpts* );
 extern void build_index_with_pestrie( PesTrie* );
 
 #endif
@@ -14,6 +14,7 @@
 #include <sys/time.h>
 #include <sys/resource.h>
 #include <unistd.h>
+#include <pthread.h>
 #include "profile_helper.h"
 
 using namespace std;
@@ -25,6 +26,8 @@ using namespace std;
 static struct rusage ru;
 static double last_tick = 0.0f;
 static int last_mem = 0;
+// The indexers may be profiled by multiple threads
+static pthread_mutex_t res_lock = PTHREAD_MUTEX_INITIALIZER;
 
 
 // Translate page numbers into megabytes
@@ -78,6 +81,7 @@ void show_res_use( const char* text, double time_scale )
   double cur_tick;
   int cur_mem;
 
+  pthread_mutex_lock( &res_lock );
   cur_tick = TIME();
   cur_mem = pick_memory(); 
   //cur_mem = ptok( ru.ru_minflt );
@@ -91,6 +95,7 @@ void show_res_use( const char* text, double time_scale )
   
   last_tick = cur_tick;
   last_mem = cur_mem;
+  pthread_mutex_unlock( &res_lock );
 }
 
 void* my_malloc( int sz )
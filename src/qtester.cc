@@ -84,6 +84,7 @@ struct QueryOpts
   bool demand_merging;
   const char* input_file;
   const char* query_plan;
+  const char* retired_list;
 
   QueryOpts()
   {
@@ -93,10 +94,15 @@ struct QueryOpts
     demand_merging = false;
     input_file = NULL;
     query_plan = NULL;
+    retired_list = NULL;
   }
 }
 query_opts;
 
+// The retired variables are compacted for COMPACT_SETS equivalent sets after every QUERY_BATCH queries
+#define QUERY_BATCH 1024
+#define COMPACT_SETS 64
+
 // Program options
 static void 
 print_help( const char* prog_name )
@@ -114,6 +120,7 @@ print_help( const char* prog_name )
   printf( "    6    : list store/load conflicts\n" );
   printf( "-s       : Use only points-to matrix for querying (Bitmap ONLY).\n" );
   printf( "-d       : Merging the figures up-to-root before querying (Pestrie ONLY).\n" );
+  printf( "-r [file]: Retire the pointers (\"p id\" per line) and objects (\"o id\") in the file before querying (Pestrie ONLY).\n" );
 }
 
 static bool 
@@ -121,7 +128,7 @@ parse_options( int argc, char **argv )
 {
   int c;
 
-  while ( (c = getopt( argc, argv, "dpst:h" ) ) != -1 ) {
+  while ( (c = getopt( argc, argv, "dpst:r:h" ) ) != -1 ) {
     switch ( c ) {
     case 'd':
       query_opts.demand_merging = true;
@@ -135,6 +142,10 @@ parse_options( int argc, char **argv )
       query_opts.trad_mode = true;
       break;
 
+    case 'r':
+      query_opts.retired_list = optarg;
+      break;
+
     case 't':
       {
 	int query_type = std::atoi( optarg );
@@ -233,6 +244,9 @@ execute_query_plan( IQuery *qs )
       }
       break;
     }
+
+    if ( ( i + 1 ) % QUERY_BATCH == 0 )
+      qs->Compact( COMPACT_SETS );
   }
 
   fprintf( stderr, "\nReference answer = %d\n", ans );
@@ -303,12 +317,41 @@ traverse_result( IQuery *qs )
       ans += qs->ListConflicts( x, ptr_filter );
       break;
     }
+
+    if ( ( i + 1 ) % QUERY_BATCH == 0 )
+      qs->Compact( COMPACT_SETS );
   }
   
   fprintf( stderr, "\nReference answer = %d\n", ans );
   delete ptr_filter;
 }
 
+// The retired pointers/objects are removed one by one, the index is compacted between the query batches
+static void
+retire_variables( IQuery *qs )
+{
+  FILE *fp = fopen( query_opts.retired_list, "r" );
+  if ( fp == NULL ) {
+    fprintf( stderr, "Cannot open the list of the retired variables.\n" );
+    return;
+  }
+
+  char kind;
+  int x;
+  int n_ptrs = 0, n_objs = 0;
+
+  while ( fscanf( fp, " %c %d", &kind, &x ) == 2 ) {
+    if ( kind == 'p' )
+      n_ptrs += ( qs->RemovePointer( x ) ? 1 : 0 );
+    else if ( kind == 'o' )
+      n_objs += ( qs->RemoveObject( x ) ? 1 : 0 );
+  }
+
+  fclose( fp );
+  fprintf( stderr, "Retired : %d pointers, %d objects, %d equivalent sets to compact\n",
+	   n_ptrs, n_objs, qs->Compact( 0 ) );
+}
+
 IQuery*
 load_index()
 {
@@ -353,6 +396,9 @@ main( int argc, char** argv )
   IQuery *qs = load_index();
   if ( qs == NULL ) return -1;
 
+  if ( query_opts.retired_list != NULL )
+    retire_variables( qs );
+
   query_opts.query_plan != NULL ? 
     execute_query_plan(qs) : traverse_result(qs);
 
@@ -66,6 +66,16 @@ public:
   virtual int nOfObjs() = 0;
   virtual int getIndexType() = 0;
 
+public:
+  // Retire pointer x or object o from the answers of the later queries
+  // Returns false if it is not in the index, or the index does not support the removals
+  virtual bool RemovePointer( int x ) { return false; }
+  virtual bool RemoveObject( int o ) { return false; }
+
+  // Reclaim the space of the retired pointers/objects for at most max_sets equivalent sets
+  // Returns the number of the sets still waiting
+  virtual int Compact( int max_sets ) { return 0; }
+
 public:
   virtual ~IQuery() {}
 };
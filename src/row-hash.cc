@@ -0,0 +1,204 @@
+// Copyright 2014, Hong Kong University of Science and Technology. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * Grouping the equal rows serially or in parallel.
+ */
+
+#include <algorithm>
+#include <vector>
+#include "row-hash.hh"
+#include "parallel.hh"
+
+using namespace std;
+
+// The rows with equal fingerprints are adjacent and ascending by the row IDs after sorting
+struct RowKey
+{
+  row_fp_t fp;
+  int id;
+
+  bool operator<( const RowKey& o ) const
+  {
+    return fp < o.fp || ( fp == o.fp && id < o.id );
+  }
+};
+
+struct SameRows
+{
+  const RowSet *rows;
+  bool operator()( int x, int y ) const { return rows->same( x, y ); }
+};
+
+struct GroupingTask
+{
+  const RowSet *rows;
+  int n, n_threads;
+  int *r_reps;
+  RowKey *keys, *buf;
+  // Thread tid works on the keys in [bounds[tid], bounds[tid+1])
+  long *bounds;
+  long *n_keys;
+  // The sorted runs being merged in the current round
+  int n_runs;
+  long *runs;
+};
+
+static void
+serial_find( const RowSet* rows, int n, int* r_reps )
+{
+  RowHashTable ht( n );
+  SameRows same;
+  same.rows = rows;
+
+  for ( int i = 0; i < n; ++i ) {
+    if ( rows->empty( i ) )
+      r_reps[i] = -1;
+    else
+      r_reps[i] = ht.insert( rows->fingerprint( i ), i, same );
+  }
+}
+
+// Phase 1: fingerprint a slice of rows and sort them
+static void
+fingerprint_worker( int tid, void* arg )
+{
+  GroupingTask *task = (GroupingTask*)arg;
+  const RowSet *rows = task->rows;
+  long lo = (long)task->n * tid / task->n_threads;
+  long hi = (long)task->n * ( tid + 1 ) / task->n_threads;
+
+  RowKey *keys = task->keys + lo;
+  long k = 0;
+
+  for ( long i = lo; i < hi; ++i ) {
+    if ( rows->empty( i ) ) {
+      task->r_reps[i] = -1;
+      continue;
+    }
+    keys[k].fp = rows->fingerprint( i );
+    keys[k].id = i;
+    ++k;
+  }
+
+  sort( keys, keys + k );
+  task->n_keys[tid] = k;
+}
+
+// Phase 2: merge the runs pairwise, run j is keys[runs[j], runs[j+1])
+static void
+merge_worker( int tid, void* arg )
+{
+  GroupingTask *task = (GroupingTask*)arg;
+  long *runs = task->runs;
+
+  for ( int j = tid * 2; j < task->n_runs; j += task->n_threads * 2 ) {
+    if ( j + 1 == task->n_runs )
+      copy( task->keys + runs[j], task->keys + runs[j+1], task->buf + runs[j] );
+    else
+      merge( task->keys + runs[j], task->keys + runs[j+1],
+	     task->keys + runs[j+1], task->keys + runs[j+2],
+	     task->buf + runs[j] );
+  }
+}
+
+// Phase 3: verify the groups of equal fingerprints
+static void
+verify_worker( int tid, void* arg )
+{
+  GroupingTask *task = (GroupingTask*)arg;
+  const RowSet *rows = task->rows;
+  const RowKey *keys = task->keys;
+  int *r_reps = task->r_reps;
+  long end = task->bounds[tid+1];
+  vector<int> reps;
+
+  for ( long g = task->bounds[tid]; g < end; ) {
+    long h = g + 1;
+    while ( h < end && keys[h].fp == keys[g].fp ) ++h;
+
+    // The distinct rows in this group, every row is equal to at most one of them
+    reps.clear();
+    for ( long i = g; i < h; ++i ) {
+      int x = keys[i].id;
+      size_t j;
+      for ( j = 0; j < reps.size(); ++j )
+	if ( rows->same( reps[j], x ) ) break;
+
+      if ( j < reps.size() )
+	r_reps[x] = reps[j];
+      else {
+	r_reps[x] = x;
+	reps.push_back( x );
+      }
+    }
+
+    g = h;
+  }
+}
+
+void
+find_equal_rows( const RowSet* rows, int n, int* r_reps, int n_threads )
+{
+  if ( n_threads > n / 1024 ) n_threads = n / 1024;
+  if ( n_threads <= 1 ) {
+    serial_find( rows, n, r_reps );
+    return;
+  }
+
+  GroupingTask task;
+  task.rows = rows;
+  task.n = n;
+  task.n_threads = n_threads;
+  task.r_reps = r_reps;
+  task.keys = new RowKey[n];
+  task.buf = new RowKey[n];
+  task.bounds = new long[n_threads+1];
+  task.n_keys = new long[n_threads];
+  task.runs = new long[n_threads+1];
+
+  parallel_execute( n_threads, fingerprint_worker, &task );
+
+  // Pack the sorted runs together
+  long total = 0;
+  for ( int t = 0; t < n_threads; ++t ) {
+    long lo = (long)n * t / n_threads;
+    if ( lo != total )
+      copy( task.keys + lo, task.keys + lo + task.n_keys[t], task.keys + total );
+    task.runs[t] = total;
+    total += task.n_keys[t];
+  }
+  task.runs[n_threads] = total;
+  task.n_runs = n_threads;
+
+  while ( task.n_runs > 1 ) {
+    parallel_execute( n_threads, merge_worker, &task );
+    swap( task.keys, task.buf );
+
+    // Every pair of runs becomes a run
+    int k = 0;
+    for ( int j = 0; j < task.n_runs; j += 2 )
+      task.runs[k++] = task.runs[j];
+    task.runs[k] = total;
+    task.n_runs = k;
+  }
+
+  // A group of equal fingerprints is never split between two threads
+  task.bounds[0] = 0;
+  for ( int t = 1; t < n_threads; ++t ) {
+    long b = total * t / n_threads;
+    if ( b < task.bounds[t-1] ) b = task.bounds[t-1];
+    while ( b > 0 && b < total && task.keys[b].fp == task.keys[b-1].fp ) ++b;
+    task.bounds[t] = b;
+  }
+  task.bounds[n_threads] = total;
+
+  parallel_execute( n_threads, verify_worker, &task );
+
+  delete[] task.keys;
+  delete[] task.buf;
+  delete[] task.bounds;
+  delete[] task.n_keys;
+  delete[] task.runs;
+}
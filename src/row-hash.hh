@@ -0,0 +1,135 @@
+// Copyright 2014, Hong Kong University of Science and Technology. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * A growable open-addressing hash table for finding the equal rows of a matrix.
+ * Every row is summarized by a 64-bit fingerprint, which is cached in the table.
+ * Two rows are compared word by word only if their fingerprints are equal,
+ * thus a full comparison almost always confirms a duplicate.
+ * The table is serial, find_equal_rows can also group the rows with multiple threads.
+ */
+
+#ifndef ROW_HASH_H
+#define ROW_HASH_H
+
+#include <cstring>
+
+typedef unsigned long long row_fp_t;
+
+#define ROW_FP_SEED 0xCBF29CE484222325ULL
+
+// Feed a word to the fingerprint
+inline row_fp_t
+row_fp_add( row_fp_t h, row_fp_t v )
+{
+  h ^= v;
+  h *= 0x100000001B3ULL;
+  return h ^ ( h >> 29 );
+}
+
+// Scramble the bits of the final fingerprint, so that the low bits are good for addressing
+inline row_fp_t
+row_fp_finish( row_fp_t h )
+{
+  h ^= h >> 30; h *= 0xBF58476D1CE4E5B9ULL;
+  h ^= h >> 27; h *= 0x94D049BB133111EBULL;
+  return h ^ ( h >> 31 );
+}
+
+class RowHashTable
+{
+public:
+  // The table is grown on demand, expected is only a hint
+  RowHashTable( int expected )
+  {
+    cap = 1024;
+    while ( cap < (long)expected ) cap <<= 1;
+    slots = new Slot[cap];
+    memset( slots, -1, sizeof(Slot) * cap );
+    used = 0;
+  }
+
+  ~RowHashTable()
+  {
+    delete[] slots;
+  }
+
+  /*
+   * Look up the row id with fingerprint fp.
+   * same(x, id) tells if row x is equal to row id, and it is called only for the equal fingerprints.
+   * Returns the row equal to id, or id itself if it is inserted as a new row.
+   */
+  template<class Same>
+  int insert( row_fp_t fp, int id, const Same& same )
+  {
+    // Keep the load factor under 1/2
+    if ( ( used + 1 ) * 2 > cap ) grow();
+
+    long mask = cap - 1;
+    for ( long p = fp & mask; ; p = ( p + 1 ) & mask ) {
+      Slot &s = slots[p];
+      if ( s.id == -1 ) {
+	s.fp = fp;
+	s.id = id;
+	++used;
+	return id;
+      }
+      if ( s.fp == fp && same( s.id, id ) ) return s.id;
+    }
+  }
+
+private:
+  struct Slot
+  {
+    row_fp_t fp;
+    long id;
+  };
+
+  // The cached fingerprints are reused for rehashing
+  void grow()
+  {
+    long old_cap = cap;
+    Slot *old = slots;
+
+    cap <<= 1;
+    slots = new Slot[cap];
+    memset( slots, -1, sizeof(Slot) * cap );
+
+    long mask = cap - 1;
+    for ( long i = 0; i < old_cap; ++i ) {
+      if ( old[i].id == -1 ) continue;
+      long p = old[i].fp & mask;
+      while ( slots[p].id != -1 ) p = ( p + 1 ) & mask;
+      slots[p] = old[i];
+    }
+
+    delete[] old;
+  }
+
+private:
+  Slot *slots;
+  long cap, used;
+};
+
+// The rows to be grouped, accessed only through these functions
+class RowSet
+{
+public:
+  virtual ~RowSet() {}
+  virtual bool empty( int i ) const = 0;
+  virtual row_fp_t fingerprint( int i ) const = 0;
+  virtual bool same( int x, int y ) const = 0;
+};
+
+/*
+ * Find the equal rows of the first n rows.
+ * r_reps[i] receives the first row equal to row i (possibly i itself), or -1 if row i is empty.
+ * With more than one thread, the rows are fingerprinted and sorted by the fingerprints in parallel,
+ * and then the groups of equal fingerprints are verified in parallel.
+ * The result is the same for any number of threads.
+ */
+extern void
+find_equal_rows( const RowSet*, int n, int* r_reps, int n_threads = 1 );
+
+#endif
@@ -129,8 +129,8 @@ SegTree::query_point( int x, int y )
       if ( x == mid ) {
 	if ( y <= pl->y2 ) return true;
       }
-      else {
-	// pl->get_type() == SIG_RECT
+      else if ( pl->get_type() == SIG_RECT ) {
+	// A vertical line stored at mid never covers x
 	Rectangle* r = (Rectangle*)pl;
 	if ( r->x1 <= x && x <= r->x2 && y <= r->y2 ) 
 	  return true;
@@ -180,6 +180,36 @@ SegTree::insert_segtree( const Rectangle& r )
   n_pairs += (r.x2-r.x1+1) * (r.y2-r.y1+1);
 }
 
+/*
+ * The figures are moved without copying, and the other tree is left empty.
+ * A figure is kept behind the figures of this tree with the same y1.
+ */
+void
+SegTree::absorb( SegTree* o )
+{
+  for ( int i = 0; i < maxN; ++i ) {
+    SegTreeNode *q = o->unitNodes[i];
+    if ( q == NULL ) continue;
+
+    if ( unitNodes[i] == NULL )
+      unitNodes[i] = q;
+    else {
+      unitNodes[i]->rects = join_treap( unitNodes[i]->rects, q->rects );
+      q->rects = NULL;
+      delete q;
+    }
+    o->unitNodes[i] = NULL;
+  }
+
+  n_points += o->n_points;
+  n_horizs += o->n_horizs;
+  n_vertis += o->n_vertis;
+  n_rects += o->n_rects;
+  n_pairs += o->n_pairs;
+  o->n_points = o->n_horizs = o->n_vertis = o->n_rects = 0;
+  o->n_pairs = 0;
+}
+
 /*
  * Aligning the figures by their left bounds.
  */
@@ -53,6 +53,8 @@ public:
   void insert_segtree( const Rectangle& );
   void flush_left_shapes();
   int dump_figures( std::FILE* );
+  // Move the figures of another segment tree with the same range into this one
+  void absorb( SegTree* );
 
 private:
   void insert_rectangle( int, int, VLine* );
@@ -102,20 +102,19 @@ find_treap( struct TreapNode *p, int y )
 }
 
 // We sort the treap nodes by the lower y axis of the contained shapes
-struct TreapNode* 
-insert_treap( struct TreapNode* p, VLine *r )
+static struct TreapNode* 
+insert_node( struct TreapNode* p, struct TreapNode* t )
 {
   if ( p == NULL ) {
-    // Now we create a new tree node
-    p = new TreapNode(r);
+    p = t;
   }
   else {
-    if ( r->y1 < p->data->y1 ) {
-      p->left = insert_treap( p->left, r );
+    if ( t->data->y1 < p->data->y1 ) {
+      p->left = insert_node( p->left, t );
       if ( p->left->rkey < p->rkey ) p = rotate_right( p );
     }
     else {
-      p->right = insert_treap( p->right, r );
+      p->right = insert_node( p->right, t );
       if ( p->right->rkey < p->rkey ) p = rotate_left( p );
     }
   }
@@ -123,6 +122,13 @@ insert_treap( struct TreapNode* p, VLine *r )
   return p;
 }
 
+struct TreapNode* 
+insert_treap( struct TreapNode* p, VLine *r )
+{
+  // Now we create a new tree node
+  return insert_node( p, new TreapNode(r) );
+}
+
 // Remove the specified treap node
 struct TreapNode*
 remove_treap( struct TreapNode* p, int y )
@@ -174,3 +180,16 @@ clean_treap( struct TreapNode* p )
   delete p;
 }
 
+// Move the nodes of q into p in order, the nodes with equal keys keep their relative order
+struct TreapNode*
+join_treap( struct TreapNode* p, struct TreapNode* q )
+{
+  if ( q == NULL ) return p;
+
+  TreapNode *left = q->left, *right = q->right;
+  q->left = q->right = NULL;
+
+  p = join_treap( p, left );
+  p = insert_node( p, q );
+  return join_treap( p, right );
+}
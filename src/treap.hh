@@ -35,6 +35,7 @@ TreapNode* insert_treap( TreapNode*, VLine* );
 TreapNode* remove_treap( TreapNode*, int );
 void inorder_treap( TreapNode*, VECTOR(VLine*)& );
 void clean_treap( TreapNode* );
+TreapNode* join_treap( TreapNode*, TreapNode* );
 
 
 #endif